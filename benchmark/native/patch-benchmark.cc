@@ -0,0 +1,62 @@
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include "catch.hpp"
+#include "patch.h"
+
+using namespace std::chrono;
+using std::vector;
+
+static Point get_random_point() {
+  return Point(rand() % 100000, rand() % 100);
+}
+
+static Point get_random_extent() {
+  return Point(rand() % 10 < 8 ? 0 : rand() % 3, rand() % 10);
+}
+
+TEST_CASE("Patch::splice") {
+  srand(0);
+  uint32_t count = 200000;
+  vector<Point> starts, deletion_extents, insertion_extents;
+  for (uint32_t i = 0; i < count; i++) {
+    starts.push_back(get_random_point());
+    deletion_extents.push_back(get_random_extent());
+    insertion_extents.push_back(get_random_extent());
+  }
+
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  size_t change_count = 0;
+  for (uint32_t round = 0; round < 3; round++) {
+    Patch patch;
+    for (uint32_t i = 0; i < count; i++) {
+      patch.splice(starts[i], deletion_extents[i], insertion_extents[i]);
+      patch.grab_change_starting_before_new_position(starts[(i * 7) % count]);
+    }
+    change_count += patch.get_change_count();
+  }
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Splicing " << (end - start).count() << "\n";
+
+  REQUIRE(change_count > 0);
+}
+
+TEST_CASE("Patch::copy") {
+  srand(0);
+  Patch patch;
+  for (uint32_t i = 0; i < 100000; i++) {
+    patch.splice(get_random_point(), get_random_extent(), get_random_extent());
+  }
+
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  size_t change_count = 0;
+  for (uint32_t i = 0; i < 100; i++) {
+    Patch copy = patch.copy();
+    change_count += copy.invert().get_change_count();
+  }
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Copying " << (end - start).count() << "\n";
+
+  REQUIRE(change_count == 100 * patch.get_change_count());
+}
@@ -0,0 +1,53 @@
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include "catch.hpp"
+#include "newline-scanner.h"
+#include "text.h"
+
+using namespace std::chrono;
+using std::vector;
+
+static Text::String get_random_content(uint32_t size) {
+  Text::String result;
+  result.reserve(size);
+  for (uint32_t i = 0; i < size; i++) {
+    result.push_back(rand() % 40 == 0 ? '\n' : 'a' + rand() % 26);
+  }
+  return result;
+}
+
+TEST_CASE("Text - computing line offsets") {
+  srand(0);
+  uint32_t size = 64 * 1024 * 1024;
+  Text::String content = get_random_content(size);
+
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  vector<uint32_t> scalar_line_offsets{0};
+  for (uint32_t offset = 0; offset < size; offset++) {
+    if (content[offset] == '\n') scalar_line_offsets.push_back(offset + 1);
+  }
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Scalar scan " << (end - start).count() << "\n";
+
+  start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  vector<uint32_t> line_offsets{0};
+  append_line_offsets(line_offsets, content.data(), content.data() + content.size());
+  end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Vectorized scan " << (end - start).count() << "\n";
+
+  REQUIRE(line_offsets == scalar_line_offsets);
+}
+
+TEST_CASE("Text - computing digests") {
+  srand(0);
+  Text text{get_random_content(64 * 1024 * 1024)};
+
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  size_t digest = text.digest();
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Digest " << (end - start).count() << "\n";
+
+  REQUIRE(Text{text}.digest() == digest);
+}
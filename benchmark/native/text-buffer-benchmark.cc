@@ -0,0 +1,56 @@
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include "catch.hpp"
+#include "text-buffer.h"
+
+using namespace std::chrono;
+using std::pair;
+using std::vector;
+
+static Text::String get_content(uint32_t line_count) {
+  Text::String result;
+  for (uint32_t row = 0; row < line_count; row++) {
+    for (uint32_t column = 0; column < 30; column++) result.push_back('a' + (row + column) % 26);
+    result.push_back('\n');
+  }
+  return result;
+}
+
+static vector<pair<Range, Text::String>> get_replacements(uint32_t line_count) {
+  vector<pair<Range, Text::String>> result;
+  for (uint32_t row = 0; row < line_count; row++) {
+    result.push_back({Range{Point(row, 10), Point(row, 13)}, Text::String{'x', 'y', 'z', 'w'}});
+  }
+  return result;
+}
+
+TEST_CASE("TextBuffer::set_text_in_ranges") {
+  uint32_t count = 50000;
+  Text::String content = get_content(count);
+
+  TextBuffer buffer{Text::String(content)};
+  for (uint32_t row = 0; row < count; row += 500) {
+    buffer.set_text_in_range({{row, 3}, {row, 5}}, u"XY");
+  }
+  auto replacements = get_replacements(count);
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  buffer.set_text_in_ranges(std::move(replacements));
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Batched replacements " << (end - start).count() << "\n";
+
+  TextBuffer separately_edited_buffer{Text::String(content)};
+  for (uint32_t row = 0; row < count; row += 500) {
+    separately_edited_buffer.set_text_in_range({{row, 3}, {row, 5}}, u"XY");
+  }
+  replacements = get_replacements(count);
+  start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  for (auto iter = replacements.rbegin(); iter != replacements.rend(); ++iter) {
+    separately_edited_buffer.set_text_in_range(iter->first, std::move(iter->second));
+  }
+  end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Separate replacements " << (end - start).count() << "\n";
+
+  REQUIRE(buffer.text() == separately_edited_buffer.text());
+}
@@ -30,6 +30,7 @@
             "sources": [
                 "src/core/encoding-conversion.cc",
                 "src/core/marker-index.cc",
+                "src/core/newline-scanner.cc",
                 "src/core/patch.cc",
                 "src/core/point.cc",
                 "src/core/range.cc",
@@ -85,6 +86,7 @@
                     "test/native/tests.cc",
                     "test/native/encoding-conversion-test.cc",
                     "test/native/patch-test.cc",
+                    "test/native/slab-allocator-test.cc",
                     "test/native/text-buffer-test.cc",
                     "test/native/text-test.cc",
                     "test/native/text-diff-test.cc",
@@ -90,17 +90,22 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
     })
   }
 
-  TextBuffer.prototype.save = function (destination, encoding = 'UTF8') {
+  TextBuffer.prototype.save = function (destination, options = 'UTF8') {
     const CHUNK_SIZE = 10 * 1024
 
-    encoding = normalizeEncoding(encoding)
+    if (typeof options !== 'object') {
+      options = {encoding: options}
+    }
+
+    const encoding = normalizeEncoding(options.encoding || 'UTF8')
+    const flushInBackground = options.flushInBackground === true ? true : false
 
     return new Promise((resolve, reject) => {
       if (typeof destination === 'string') {
         const filePath = destination
         save.call(this, filePath, encoding, (error) => {
           error ? reject(error) : resolve()
-        })
+        }, flushInBackground)
       } else {
         const stream = destination
         stream.on('error', reject)
@@ -115,8 +120,12 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
             stream.write(buffer.slice(0, bytesRead), writeToStream)
           } else {
             stream.end(() => {
-              reader.end()
-              resolve()
+              if (flushInBackground) {
+                reader.end(resolve)
+              } else {
+                reader.end()
+                resolve()
+              }
             })
           }
         }
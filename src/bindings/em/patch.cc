@@ -88,6 +88,7 @@ EMSCRIPTEN_BINDINGS(Patch) {
     .function("changeForNewPosition", WRAP(&Patch::grab_change_starting_before_new_position))
     .function("getBounds", WRAP(&Patch::get_bounds))
     .function("rebalance", WRAP(&Patch::rebalance))
+    .function("getMemoryUsage", WRAP(&Patch::memory_usage))
     .function("serialize", WRAP(&serialize))
     .class_function("compose", WRAP_STATIC(&compose), emscripten::allow_raw_pointers())
     .class_function("deserialize", WRAP_STATIC(&deserialize), emscripten::allow_raw_pointers());
@@ -99,4 +100,10 @@ EMSCRIPTEN_BINDINGS(Patch) {
     .field("newEnd", WRAP_FIELD(Patch::Change, new_end))
     .field("oldText", WRAP_FIELD(Patch::Change, old_text))
     .field("newText", WRAP_FIELD(Patch::Change, new_text));
+
+  emscripten::value_object<Patch::MemoryUsage>("PatchMemoryUsage")
+    .field("nodeCount", &Patch::MemoryUsage::node_count)
+    .field("nodeBytes", &Patch::MemoryUsage::node_bytes)
+    .field("oldTextBytes", &Patch::MemoryUsage::old_text_bytes)
+    .field("newTextBytes", &Patch::MemoryUsage::new_text_bytes);
 }
@@ -1,6 +1,8 @@
 #include "auto-wrap.h"
 #include "text-buffer.h"
 #include <emscripten/bind.h>
+#include <algorithm>
+#include <limits>
 
 using std::string;
 using std::u16string;
@@ -52,6 +54,30 @@ static uint32_t character_index_for_position(TextBuffer &buffer, Point position)
   return buffer.clip_position(position).offset;
 }
 
+static uint32_t clip_offset(double offset) {
+  if (offset < 0) return 0;
+  return std::min(offset, static_cast<double>(std::numeric_limits<uint32_t>::max()));
+}
+
+static Point position_for_utf8_offset(TextBuffer &buffer, double offset) {
+  return buffer.position_for_utf8_offset(clip_offset(offset));
+}
+
+static Point position_for_code_point_offset(TextBuffer &buffer, double offset) {
+  return buffer.position_for_code_point_offset(clip_offset(offset));
+}
+
+static void set_text_in_ranges(TextBuffer &buffer, emscripten::val js_ranges, emscripten::val js_texts) {
+  std::vector<std::pair<Range, Text::String>> changes;
+  for (unsigned i = 0, n = js_ranges["length"].as<unsigned>(); i < n; i++) {
+    changes.push_back({
+      js_ranges[i].as<Range>(),
+      em_receive<Text::String>(js_texts[i].as<std::string>())
+    });
+  }
+  buffer.set_text_in_ranges(std::move(changes));
+}
+
 static uint32_t get_line_count(TextBuffer &buffer) {
   return buffer.extent().row + 1;
 }
@@ -62,6 +88,15 @@ static Point position_for_character_index(TextBuffer &buffer, long index) {
     buffer.position_for_offset(static_cast<uint32_t>(index));
 }
 
+static emscripten::val get_lines_in_rows(TextBuffer &buffer, uint32_t start_row, uint32_t end_row) {
+  std::vector<uint32_t> line_start_offsets;
+  auto text = buffer.lines_in_rows(start_row, end_row, &line_start_offsets);
+  emscripten::val result = emscripten::val::object();
+  result.set("text", em_transmit(text));
+  result.set("lineStartOffsets", em_transmit(line_start_offsets));
+  return result;
+}
+
 EMSCRIPTEN_BINDINGS(TextBuffer) {
   emscripten::class_<TextBuffer>("TextBuffer")
     .constructor<>()
@@ -70,16 +105,39 @@ EMSCRIPTEN_BINDINGS(TextBuffer) {
     .function("setText", WRAP_OVERLOAD(&TextBuffer::set_text, void (TextBuffer::*)(Text::String &&)))
     .function("getTextInRange", WRAP(&TextBuffer::text_in_range))
     .function("setTextInRange", WRAP_OVERLOAD(&TextBuffer::set_text_in_range, void (TextBuffer::*)(Range, Text::String &&)))
+    .function("setTextInRanges", set_text_in_ranges)
     .function("getLength", &TextBuffer::size)
     .function("getExtent", &TextBuffer::extent)
     .function("getLineCount", get_line_count)
+    .function("getLongestRow", WRAP(&TextBuffer::longest_row))
     .function("reset", WRAP(&TextBuffer::reset))
     .function("lineLengthForRow", WRAP(&TextBuffer::line_length_for_row))
     .function("lineEndingForRow", line_ending_for_row)
     .function("lineForRow", WRAP(&TextBuffer::line_for_row))
+    .function("getLinesInRows", get_lines_in_rows)
     .function("characterIndexForPosition", character_index_for_position)
     .function("positionForCharacterIndex", position_for_character_index)
+    .function("utf8OffsetForPosition", WRAP(&TextBuffer::utf8_offset_for_position))
+    .function("positionForUtf8Offset", position_for_utf8_offset)
+    .function("codePointOffsetForPosition", WRAP(&TextBuffer::code_point_offset_for_position))
+    .function("positionForCodePointOffset", position_for_code_point_offset)
     .function("isModified", WRAP_OVERLOAD(&TextBuffer::is_modified, bool (TextBuffer::*)() const))
+    .function("createCheckpoint", WRAP(&TextBuffer::create_checkpoint))
+    .function("revertToCheckpoint", WRAP(&TextBuffer::revert_to_checkpoint))
+    .function("groupChangesSince", WRAP(&TextBuffer::group_changes_since))
     .function("findSync", find_sync)
-    .function("findAllSync", find_all_sync);
+    .function("findAllSync", find_all_sync)
+    .function("getLayerStatistics", WRAP(&TextBuffer::layer_statistics))
+    .function("getMemoryUsage", WRAP(&TextBuffer::memory_usage));
+
+  emscripten::value_object<TextBuffer::LayerStatistics>("LayerStatistics")
+    .field("layerCount", &TextBuffer::LayerStatistics::layer_count)
+    .field("readDepth", &TextBuffer::LayerStatistics::read_depth)
+    .field("changeCount", &TextBuffer::LayerStatistics::change_count);
+
+  emscripten::value_object<TextBuffer::LayerMemoryUsage>("LayerMemoryUsage")
+    .field("isBaseLayer", &TextBuffer::LayerMemoryUsage::is_base_layer)
+    .field("snapshotCount", &TextBuffer::LayerMemoryUsage::snapshot_count)
+    .field("textBytes", &TextBuffer::LayerMemoryUsage::text_bytes)
+    .field("patch", &TextBuffer::LayerMemoryUsage::patch);
 }
@@ -55,6 +55,7 @@ void MarkerIndexWrapper::init(Local<Object> exports) {
   prototype_template->Set(Nan::New<String>("findEndingAt").ToLocalChecked(), Nan::New<FunctionTemplate>(find_ending_at));
   prototype_template->Set(Nan::New<String>("findBoundariesAfter").ToLocalChecked(), Nan::New<FunctionTemplate>(find_boundaries_after));
   prototype_template->Set(Nan::New<String>("dump").ToLocalChecked(), Nan::New<FunctionTemplate>(dump));
+  prototype_template->Set(Nan::New<String>("getMemoryUsage").ToLocalChecked(), Nan::New<FunctionTemplate>(get_memory_usage));
 
   start_string.Reset(Nan::Persistent<String>(Nan::New("start").ToLocalChecked()));
   end_string.Reset(Nan::Persistent<String>(Nan::New("end").ToLocalChecked()));
@@ -365,5 +366,17 @@ void MarkerIndexWrapper::dump(const Nan::FunctionCallbackInfo<Value> &info) {
   info.GetReturnValue().Set(snapshot_to_js(snapshot));
 }
 
+void MarkerIndexWrapper::get_memory_usage(const Nan::FunctionCallbackInfo<Value> &info) {
+  MarkerIndexWrapper *wrapper = Nan::ObjectWrap::Unwrap<MarkerIndexWrapper>(info.This());
+  MarkerIndex::MemoryUsage memory_usage = wrapper->marker_index.memory_usage();
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New("nodeCount").ToLocalChecked(), Nan::New<Number>(memory_usage.node_count));
+  result->Set(Nan::New("nodeBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.node_bytes));
+  result->Set(Nan::New("markerIdSetBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.marker_id_set_bytes));
+  result->Set(Nan::New("markerIdMapBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.marker_id_map_bytes));
+  result->Set(Nan::New("positionCacheBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.position_cache_bytes));
+  info.GetReturnValue().Set(result);
+}
+
 MarkerIndexWrapper::MarkerIndexWrapper(v8::Local<v8::Number> seed)
     : marker_index{static_cast<unsigned>(seed->Int32Value())} {}
@@ -126,6 +126,7 @@ void PatchWrapper::init(Local<Object> exports) {
   prototype_template->Set(Nan::New("getJSON").ToLocalChecked(), Nan::New<FunctionTemplate>(get_json));
   prototype_template->Set(Nan::New("rebalance").ToLocalChecked(), Nan::New<FunctionTemplate>(rebalance));
   prototype_template->Set(Nan::New("getChangeCount").ToLocalChecked(), Nan::New<FunctionTemplate>(get_change_count));
+  prototype_template->Set(Nan::New("getMemoryUsage").ToLocalChecked(), Nan::New<FunctionTemplate>(get_memory_usage));
   prototype_template->Set(Nan::New("getBounds").ToLocalChecked(), Nan::New<FunctionTemplate>(get_bounds));
   patch_wrapper_constructor_template.Reset(constructor_template_local);
   patch_wrapper_constructor.Reset(constructor_template_local->GetFunction());
@@ -373,6 +374,20 @@ void PatchWrapper::get_change_count(const Nan::FunctionCallbackInfo<Value> &info
   info.GetReturnValue().Set(Nan::New<Number>(change_count));
 }
 
+Local<Object> PatchWrapper::from_memory_usage(const Patch::MemoryUsage &memory_usage) {
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New("nodeCount").ToLocalChecked(), Nan::New<Number>(memory_usage.node_count));
+  result->Set(Nan::New("nodeBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.node_bytes));
+  result->Set(Nan::New("oldTextBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.old_text_bytes));
+  result->Set(Nan::New("newTextBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.new_text_bytes));
+  return result;
+}
+
+void PatchWrapper::get_memory_usage(const Nan::FunctionCallbackInfo<Value> &info) {
+  Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
+  info.GetReturnValue().Set(from_memory_usage(patch.memory_usage()));
+}
+
 void PatchWrapper::get_bounds(const Nan::FunctionCallbackInfo<Value> &info) {
   Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
   auto bounds = patch.get_bounds();
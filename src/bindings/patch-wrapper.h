@@ -5,6 +5,7 @@ class PatchWrapper : public Nan::ObjectWrap {
  public:
   static void init(v8::Local<v8::Object> exports);
   static v8::Local<v8::Value> from_patch(Patch &&);
+  static v8::Local<v8::Object> from_memory_usage(const Patch::MemoryUsage &);
 
  private:
   PatchWrapper(Patch &&patch);
@@ -24,6 +25,7 @@ class PatchWrapper : public Nan::ObjectWrap {
   static void get_dot_graph(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_json(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_change_count(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_memory_usage(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_bounds(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void rebalance(const Nan::FunctionCallbackInfo<v8::Value> &info);
 
@@ -131,17 +131,27 @@ void TextBufferWrapper::init(Local<Object> exports) {
   prototype_template->Set(Nan::New("getLength").ToLocalChecked(), Nan::New<FunctionTemplate>(get_length));
   prototype_template->Set(Nan::New("getExtent").ToLocalChecked(), Nan::New<FunctionTemplate>(get_extent));
   prototype_template->Set(Nan::New("getLineCount").ToLocalChecked(), Nan::New<FunctionTemplate>(get_line_count));
+  prototype_template->Set(Nan::New("getLongestRow").ToLocalChecked(), Nan::New<FunctionTemplate>(get_longest_row));
   prototype_template->Set(Nan::New("getTextInRange").ToLocalChecked(), Nan::New<FunctionTemplate>(get_text_in_range));
   prototype_template->Set(Nan::New("setTextInRange").ToLocalChecked(), Nan::New<FunctionTemplate>(set_text_in_range));
+  prototype_template->Set(Nan::New("setTextInRanges").ToLocalChecked(), Nan::New<FunctionTemplate>(set_text_in_ranges));
   prototype_template->Set(Nan::New("getText").ToLocalChecked(), Nan::New<FunctionTemplate>(get_text));
   prototype_template->Set(Nan::New("setText").ToLocalChecked(), Nan::New<FunctionTemplate>(set_text));
   prototype_template->Set(Nan::New("lineForRow").ToLocalChecked(), Nan::New<FunctionTemplate>(line_for_row));
   prototype_template->Set(Nan::New("lineLengthForRow").ToLocalChecked(), Nan::New<FunctionTemplate>(line_length_for_row));
   prototype_template->Set(Nan::New("lineEndingForRow").ToLocalChecked(), Nan::New<FunctionTemplate>(line_ending_for_row));
   prototype_template->Set(Nan::New("getLines").ToLocalChecked(), Nan::New<FunctionTemplate>(get_lines));
+  prototype_template->Set(Nan::New("getLinesInRows").ToLocalChecked(), Nan::New<FunctionTemplate>(get_lines_in_rows));
   prototype_template->Set(Nan::New("characterIndexForPosition").ToLocalChecked(), Nan::New<FunctionTemplate>(character_index_for_position));
   prototype_template->Set(Nan::New("positionForCharacterIndex").ToLocalChecked(), Nan::New<FunctionTemplate>(position_for_character_index));
+  prototype_template->Set(Nan::New("utf8OffsetForPosition").ToLocalChecked(), Nan::New<FunctionTemplate>(utf8_offset_for_position));
+  prototype_template->Set(Nan::New("positionForUtf8Offset").ToLocalChecked(), Nan::New<FunctionTemplate>(position_for_utf8_offset));
+  prototype_template->Set(Nan::New("codePointOffsetForPosition").ToLocalChecked(), Nan::New<FunctionTemplate>(code_point_offset_for_position));
+  prototype_template->Set(Nan::New("positionForCodePointOffset").ToLocalChecked(), Nan::New<FunctionTemplate>(position_for_code_point_offset));
   prototype_template->Set(Nan::New("isModified").ToLocalChecked(), Nan::New<FunctionTemplate>(is_modified));
+  prototype_template->Set(Nan::New("createCheckpoint").ToLocalChecked(), Nan::New<FunctionTemplate>(create_checkpoint));
+  prototype_template->Set(Nan::New("revertToCheckpoint").ToLocalChecked(), Nan::New<FunctionTemplate>(revert_to_checkpoint));
+  prototype_template->Set(Nan::New("groupChangesSince").ToLocalChecked(), Nan::New<FunctionTemplate>(group_changes_since));
   prototype_template->Set(Nan::New("load").ToLocalChecked(), Nan::New<FunctionTemplate>(load));
   prototype_template->Set(Nan::New("save").ToLocalChecked(), Nan::New<FunctionTemplate>(save));
   prototype_template->Set(Nan::New("loadSync").ToLocalChecked(), Nan::New<FunctionTemplate>(load_sync));
@@ -154,6 +164,8 @@ void TextBufferWrapper::init(Local<Object> exports) {
   prototype_template->Set(Nan::New("findSync").ToLocalChecked(), Nan::New<FunctionTemplate>(find_sync));
   prototype_template->Set(Nan::New("findAllSync").ToLocalChecked(), Nan::New<FunctionTemplate>(find_all_sync));
   prototype_template->Set(Nan::New("getDotGraph").ToLocalChecked(), Nan::New<FunctionTemplate>(dot_graph));
+  prototype_template->Set(Nan::New("getLayerStatistics").ToLocalChecked(), Nan::New<FunctionTemplate>(get_layer_statistics));
+  prototype_template->Set(Nan::New("getMemoryUsage").ToLocalChecked(), Nan::New<FunctionTemplate>(get_memory_usage));
   RegexWrapper::init();
   exports->Set(Nan::New("TextBuffer").ToLocalChecked(), constructor_template->GetFunction());
 }
@@ -184,6 +196,11 @@ void TextBufferWrapper::get_line_count(const Nan::FunctionCallbackInfo<Value> &i
   info.GetReturnValue().Set(Nan::New(text_buffer.extent().row + 1));
 }
 
+void TextBufferWrapper::get_longest_row(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  info.GetReturnValue().Set(Nan::New(text_buffer.longest_row()));
+}
+
 void TextBufferWrapper::get_text_in_range(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   auto range = RangeWrapper::range_from_js(info[0]);
@@ -214,6 +231,32 @@ void TextBufferWrapper::set_text_in_range(const Nan::FunctionCallbackInfo<Value>
   }
 }
 
+void TextBufferWrapper::set_text_in_ranges(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  if (!info[0]->IsArray() || !info[1]->IsArray()) {
+    Nan::ThrowTypeError("Expected an array of ranges and an array of strings");
+    return;
+  }
+
+  Local<Array> js_ranges = info[0].As<Array>();
+  Local<Array> js_texts = info[1].As<Array>();
+  if (js_ranges->Length() != js_texts->Length()) {
+    Nan::ThrowTypeError("Expected the same number of ranges and strings");
+    return;
+  }
+
+  vector<pair<Range, Text::String>> changes;
+  changes.reserve(js_ranges->Length());
+  for (uint32_t i = 0, n = js_ranges->Length(); i < n; i++) {
+    auto range = RangeWrapper::range_from_js(js_ranges->Get(i));
+    auto text = TextWrapper::string_from_js(js_texts->Get(i));
+    if (!range || !text) return;
+    changes.push_back({*range, move(*text)});
+  }
+
+  text_buffer.set_text_in_ranges(move(changes));
+}
+
 void TextBufferWrapper::set_text(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   auto text = TextWrapper::string_from_js(info[0]);
@@ -265,16 +308,42 @@ void TextBufferWrapper::get_lines(const Nan::FunctionCallbackInfo<Value> &info)
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   auto result = Nan::New<Array>();
 
-  for (uint32_t row = 0, row_count = text_buffer.extent().row + 1; row < row_count; row++) {
+  vector<uint32_t> line_start_offsets;
+  auto text = text_buffer.lines_in_rows(0, UINT32_MAX, &line_start_offsets);
+  for (uint32_t row = 0; row + 1 < line_start_offsets.size(); row++) {
     Local<String> line;
-    auto text = text_buffer.text_in_range({{row, 0}, {row, UINT32_MAX}});
-    if (!Nan::New<String>(text.data(), text.size()).ToLocal(&line)) return;
+    uint32_t line_start_offset = line_start_offsets[row];
+    uint32_t line_length = line_start_offsets[row + 1] - line_start_offset;
+    if (!Nan::New<String>(text.data() + line_start_offset, line_length).ToLocal(&line)) return;
     result->Set(row, line);
   }
 
   info.GetReturnValue().Set(result);
 }
 
+void TextBufferWrapper::get_lines_in_rows(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto start_row = Nan::To<uint32_t>(info[0]);
+  auto end_row = Nan::To<uint32_t>(info[1]);
+  if (start_row.IsJust() && end_row.IsJust()) {
+    vector<uint32_t> line_start_offsets;
+    auto text = text_buffer.lines_in_rows(start_row.FromJust(), end_row.FromJust(), &line_start_offsets);
+
+    Local<String> js_text;
+    if (!Nan::New<String>(text.data(), text.size()).ToLocal(&js_text)) return;
+
+    auto length = line_start_offsets.size();
+    auto buffer = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), length * sizeof(uint32_t));
+    auto js_line_start_offsets = v8::Uint32Array::New(buffer, 0, length);
+    memcpy(buffer->GetContents().Data(), line_start_offsets.data(), length * sizeof(uint32_t));
+
+    auto result = Nan::New<Object>();
+    result->Set(Nan::New("text").ToLocalChecked(), js_text);
+    result->Set(Nan::New("lineStartOffsets").ToLocalChecked(), js_line_start_offsets);
+    info.GetReturnValue().Set(result);
+  }
+}
+
 void TextBufferWrapper::character_index_for_position(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   auto position = PointWrapper::point_from_js(info[0]);
@@ -298,6 +367,48 @@ void TextBufferWrapper::position_for_character_index(const Nan::FunctionCallback
   }
 }
 
+void TextBufferWrapper::utf8_offset_for_position(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto position = PointWrapper::point_from_js(info[0]);
+  if (position) {
+    info.GetReturnValue().Set(Nan::New<Number>(text_buffer.utf8_offset_for_position(*position)));
+  }
+}
+
+void TextBufferWrapper::position_for_utf8_offset(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto maybe_offset = Nan::To<int64_t>(info[0]);
+  if (maybe_offset.IsJust()) {
+    int64_t offset = maybe_offset.FromJust();
+    info.GetReturnValue().Set(
+      PointWrapper::from_point(text_buffer.position_for_utf8_offset(
+        std::min<int64_t>(std::max<int64_t>(0, offset), UINT32_MAX)
+      ))
+    );
+  }
+}
+
+void TextBufferWrapper::code_point_offset_for_position(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto position = PointWrapper::point_from_js(info[0]);
+  if (position) {
+    info.GetReturnValue().Set(Nan::New<Number>(text_buffer.code_point_offset_for_position(*position)));
+  }
+}
+
+void TextBufferWrapper::position_for_code_point_offset(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto maybe_offset = Nan::To<int64_t>(info[0]);
+  if (maybe_offset.IsJust()) {
+    int64_t offset = maybe_offset.FromJust();
+    info.GetReturnValue().Set(
+      PointWrapper::from_point(text_buffer.position_for_code_point_offset(
+        std::min<int64_t>(std::max<int64_t>(0, offset), UINT32_MAX)
+      ))
+    );
+  }
+}
+
 void TextBufferWrapper::find_sync(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   const Regex *regex = RegexWrapper::regex_from_js(info[0]);
@@ -377,6 +488,27 @@ void TextBufferWrapper::is_modified(const Nan::FunctionCallbackInfo<Value> &info
   info.GetReturnValue().Set(Nan::New<Boolean>(text_buffer.is_modified()));
 }
 
+void TextBufferWrapper::create_checkpoint(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  info.GetReturnValue().Set(Nan::New<Number>(text_buffer.create_checkpoint()));
+}
+
+void TextBufferWrapper::revert_to_checkpoint(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto maybe_id = Nan::To<uint32_t>(info[0]);
+  if (maybe_id.IsJust()) {
+    info.GetReturnValue().Set(Nan::New<Boolean>(text_buffer.revert_to_checkpoint(maybe_id.FromJust())));
+  }
+}
+
+void TextBufferWrapper::group_changes_since(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto maybe_id = Nan::To<uint32_t>(info[0]);
+  if (maybe_id.IsJust()) {
+    info.GetReturnValue().Set(Nan::New<Boolean>(text_buffer.group_changes_since(maybe_id.FromJust())));
+  }
+}
+
 static const int INVALID_ENCODING = -1;
 
 static Local<Value> error_for_number(int error_number, string encoding_name, string file_name) {
@@ -507,7 +639,7 @@ class LoadWorker : public Nan::AsyncProgressWorkerBase<size_t> {
     delete snapshot;
 
     if (compute_patch && inverted_changes.get_change_count() > 0) {
-      inverted_changes.combine(patch);
+      inverted_changes.combine(move(patch));
       patch = move(inverted_changes);
     }
 
@@ -650,17 +782,31 @@ class SaveWorker : public Nan::AsyncWorker {
   TextBuffer::Snapshot *snapshot;
   string file_name;
   string encoding_name;
+  bool flush_in_background;
   optional<int> error_number;
+  optional<Text> preceding_text;
 
  public:
   SaveWorker(Nan::Callback *completion_callback, TextBuffer::Snapshot *snapshot,
-             string &&file_name, string &&encoding_name) :
+             string &&file_name, string &&encoding_name,
+             bool flush_in_background = false) :
     AsyncWorker(completion_callback),
     snapshot{snapshot},
     file_name{file_name},
-    encoding_name(encoding_name) {}
+    encoding_name(encoding_name),
+    flush_in_background{flush_in_background} {}
 
   void Execute() {
+    write_file();
+
+    // Build the flushed text here so that the main thread only needs to
+    // store it, rather than materializing it while finishing the save.
+    if (flush_in_background) {
+      preceding_text = snapshot->compute_preceding_text();
+    }
+  }
+
+  void write_file() {
     auto conversion = transcoding_to(encoding_name.c_str());
     if (!conversion) {
       error_number = INVALID_ENCODING;
@@ -692,7 +838,11 @@ class SaveWorker : public Nan::AsyncWorker {
   }
 
   Local<Value> Finish() {
-    snapshot->flush_preceding_changes();
+    if (preceding_text) {
+      snapshot->flush_preceding_changes(move(*preceding_text));
+    } else {
+      snapshot->flush_preceding_changes();
+    }
     delete snapshot;
     if (error_number) {
       return error_for_number(*error_number, encoding_name, file_name);
@@ -744,11 +894,13 @@ void TextBufferWrapper::save(const Nan::FunctionCallbackInfo<Value> &info) {
   string encoding_name = *String::Utf8Value(info[1].As<String>());
 
   Nan::Callback *completion_callback = new Nan::Callback(info[2].As<Function>());
+  bool flush_in_background = info[3]->IsTrue();
   Nan::AsyncQueueWorker(new SaveWorker(
     completion_callback,
     text_buffer.create_snapshot(),
     move(file_path),
-    move(encoding_name)
+    move(encoding_name),
+    flush_in_background
   ));
 }
 
@@ -791,7 +943,7 @@ void TextBufferWrapper::base_text_digest(const Nan::FunctionCallbackInfo<Value>
     std::setfill('0') <<
     std::setw(2 * sizeof(size_t)) <<
     std::hex <<
-    text_buffer.base_text().digest();
+    text_buffer.base_text_digest();
   Local<String> result;
   if (Nan::New(stream.str()).ToLocal(&result)) {
     info.GetReturnValue().Set(result);
@@ -802,3 +954,28 @@ void TextBufferWrapper::dot_graph(const Nan::FunctionCallbackInfo<Value> &info)
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   info.GetReturnValue().Set(Nan::New<String>(text_buffer.get_dot_graph()).ToLocalChecked());
 }
+
+void TextBufferWrapper::get_layer_statistics(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto statistics = text_buffer.layer_statistics();
+  auto result = Nan::New<Object>();
+  result->Set(Nan::New("layerCount").ToLocalChecked(), Nan::New<Number>(statistics.layer_count));
+  result->Set(Nan::New("readDepth").ToLocalChecked(), Nan::New<Number>(statistics.read_depth));
+  result->Set(Nan::New("changeCount").ToLocalChecked(), Nan::New<Number>(statistics.change_count));
+  info.GetReturnValue().Set(result);
+}
+
+void TextBufferWrapper::get_memory_usage(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto layers = text_buffer.memory_usage();
+  auto result = Nan::New<Array>(layers.size());
+  for (uint32_t i = 0; i < layers.size(); i++) {
+    auto layer = Nan::New<Object>();
+    layer->Set(Nan::New("isBaseLayer").ToLocalChecked(), Nan::New<Boolean>(layers[i].is_base_layer));
+    layer->Set(Nan::New("snapshotCount").ToLocalChecked(), Nan::New<Number>(layers[i].snapshot_count));
+    layer->Set(Nan::New("textBytes").ToLocalChecked(), Nan::New<Number>(layers[i].text_bytes));
+    layer->Set(Nan::New("patch").ToLocalChecked(), PatchWrapper::from_memory_usage(layers[i].patch));
+    result->Set(i, layer);
+  }
+  info.GetReturnValue().Set(result);
+}
@@ -14,20 +14,30 @@ private:
   static void get_length(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_extent(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_line_count(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_longest_row(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_text(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_text_in_range(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void set_text(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void set_text_in_range(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void set_text_in_ranges(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void line_for_row(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void line_length_for_row(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void line_ending_for_row(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_lines(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_lines_in_rows(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void character_index_for_position(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void position_for_character_index(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void utf8_offset_for_position(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void position_for_utf8_offset(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void code_point_offset_for_position(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void position_for_code_point_offset(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void find(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void find_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void find_all_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void is_modified(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void create_checkpoint(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void revert_to_checkpoint(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void group_changes_since(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void load_(const Nan::FunctionCallbackInfo<v8::Value> &info, bool force);
   static void load(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void reload(const Nan::FunctionCallbackInfo<v8::Value> &info);
@@ -39,6 +49,8 @@ private:
   static void reset(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void base_text_digest(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void dot_graph(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_layer_statistics(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_memory_usage(const Nan::FunctionCallbackInfo<v8::Value> &info);
 };
 
 #endif // SUPERSTRING_TEXT_BUFFER_WRAPPER_H
@@ -85,7 +85,42 @@ void TextReader::read(const Nan::FunctionCallbackInfo<Value> &info) {
   info.GetReturnValue().Set(Nan::New<Number>(total_bytes_written));
 }
 
+class FlushWorker : public Nan::AsyncWorker {
+  TextBuffer::Snapshot *snapshot;
+  Text preceding_text;
+
+ public:
+  FlushWorker(Nan::Callback *completion_callback, TextBuffer::Snapshot *snapshot) :
+    AsyncWorker(completion_callback),
+    snapshot{snapshot} {}
+
+  void Execute() {
+    preceding_text = snapshot->compute_preceding_text();
+  }
+
+  void HandleOKCallback() {
+    snapshot->flush_preceding_changes(move(preceding_text));
+    delete snapshot;
+    callback->Call(0, nullptr);
+  }
+};
+
 void TextReader::end(const Nan::FunctionCallbackInfo<Value> &info) {
   TextReader *reader = Nan::ObjectWrap::Unwrap<TextReader>(info.This()->ToObject());
-  reader->snapshot->flush_preceding_changes();
+  if (!reader->snapshot) return;
+
+  // If a callback is given, build the flushed text on a background thread and
+  // store it in the buffer once that is done.
+  if (info[0]->IsFunction()) {
+    auto worker = new FlushWorker(
+      new Nan::Callback(info[0].As<Function>()),
+      reader->snapshot
+    );
+    worker->SaveToPersistent("reader", info.This());
+    reader->snapshot = nullptr;
+    reader->slice_index = reader->slices.size();
+    Nan::AsyncQueueWorker(worker);
+  } else {
+    reader->snapshot->flush_preceding_changes();
+  }
 }
\ No newline at end of file
@@ -60,6 +60,10 @@ public:
   size_t size() const {
     return contents.size();
   }
+
+  size_t capacity() const {
+    return contents.capacity();
+  }
 };
 
 #endif // SUPERSTRING_FLAT_SET_H
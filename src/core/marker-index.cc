@@ -711,6 +711,43 @@ unordered_map<MarkerIndex::MarkerId, Range> MarkerIndex::dump() {
   return iterator.dump();
 }
 
+// Hash tables allocate a bucket array plus one node per entry, each of which
+// holds the next pointer and the value.
+template <typename Map>
+static size_t unordered_map_memory_usage(const Map &map) {
+  return map.bucket_count() * sizeof(void *) +
+    map.size() * (sizeof(void *) + sizeof(typename Map::value_type));
+}
+
+MarkerIndex::MemoryUsage MarkerIndex::memory_usage() const {
+  MemoryUsage result{
+    0,
+    0,
+    exclusive_marker_ids.capacity() * sizeof(MarkerId),
+    unordered_map_memory_usage(start_nodes_by_id) + unordered_map_memory_usage(end_nodes_by_id),
+    unordered_map_memory_usage(node_position_cache)
+  };
+
+  std::vector<const Node *> node_stack;
+  if (root) node_stack.push_back(root);
+  while (!node_stack.empty()) {
+    const Node *node = node_stack.back();
+    node_stack.pop_back();
+    result.node_count++;
+    result.marker_id_set_bytes += sizeof(MarkerId) * (
+      node->left_marker_ids.capacity() +
+      node->right_marker_ids.capacity() +
+      node->start_marker_ids.capacity() +
+      node->end_marker_ids.capacity()
+    );
+    if (node->left) node_stack.push_back(node->left);
+    if (node->right) node_stack.push_back(node->right);
+  }
+  result.node_bytes = result.node_count * sizeof(Node);
+
+  return result;
+}
+
 Point MarkerIndex::get_node_position(const Node *node) const {
   auto cache_entry = node_position_cache.find(node);
   if (cache_entry == node_position_cache.end()) {
@@ -30,6 +30,14 @@ public:
     std::vector<Boundary> boundaries;
   };
 
+  struct MemoryUsage {
+    size_t node_count;
+    size_t node_bytes;
+    size_t marker_id_set_bytes;
+    size_t marker_id_map_bytes;
+    size_t position_cache_bytes;
+  };
+
   MarkerIndex(unsigned seed = 0u);
   ~MarkerIndex();
   int generate_random_number();
@@ -53,6 +61,7 @@ public:
   BoundaryQueryResult find_boundaries_after(Point start, size_t max_count);
 
   std::unordered_map<MarkerId, Range> dump();
+  MemoryUsage memory_usage() const;
 
 private:
   friend class Iterator;
@@ -0,0 +1,127 @@
+#include "newline-scanner.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SUPERSTRING_HAS_SSE2
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+using std::vector;
+
+typedef void (*Scanner)(vector<uint32_t> &, const uint16_t *, const uint16_t *, uint32_t);
+
+static void append_line_offsets_scalar(vector<uint32_t> &line_offsets,
+                                       const uint16_t *begin, const uint16_t *end,
+                                       uint32_t base_offset) {
+  for (const uint16_t *character = begin; character != end; character++) {
+    if (*character == '\n') {
+      line_offsets.push_back(base_offset + (character - begin) + 1);
+    }
+  }
+}
+
+#ifdef SUPERSTRING_HAS_SSE2
+
+static inline uint32_t count_trailing_zeros(uint32_t value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long result;
+  _BitScanForward(&result, value);
+  return result;
+#else
+  return __builtin_ctz(value);
+#endif
+}
+
+// Each set bit in `mask` marks a newline at that index past `offset`.
+static inline void append_line_offsets_for_mask(vector<uint32_t> &line_offsets,
+                                                uint32_t mask, uint32_t offset) {
+  while (mask) {
+    line_offsets.push_back(offset + count_trailing_zeros(mask) + 1);
+    mask &= mask - 1;
+  }
+}
+
+static void append_line_offsets_sse2(vector<uint32_t> &line_offsets,
+                                     const uint16_t *begin, const uint16_t *end,
+                                     uint32_t base_offset) {
+  const __m128i newline = _mm_set1_epi16('\n');
+  const uint16_t *character = begin;
+  for (; end - character >= 16; character += 16) {
+    __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(character));
+    __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(character + 8));
+
+    // Narrow the two 16-bit comparison results to one byte per code unit, so
+    // that each bit of the mask corresponds to one code unit.
+    __m128i matches = _mm_packs_epi16(
+      _mm_cmpeq_epi16(first, newline),
+      _mm_cmpeq_epi16(second, newline)
+    );
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(matches));
+    append_line_offsets_for_mask(line_offsets, mask, base_offset + (character - begin));
+  }
+
+  append_line_offsets_scalar(line_offsets, character, end, base_offset + (character - begin));
+}
+
+TARGET_AVX2
+static void append_line_offsets_avx2(vector<uint32_t> &line_offsets,
+                                     const uint16_t *begin, const uint16_t *end,
+                                     uint32_t base_offset) {
+  const __m256i newline = _mm256_set1_epi16('\n');
+  const uint16_t *character = begin;
+  for (; end - character >= 32; character += 32) {
+    __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(character));
+    __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(character + 16));
+
+    // The pack instruction works within 128-bit lanes, so the 64-bit quarters
+    // of its result need to be reordered to restore the original ordering.
+    __m256i matches = _mm256_permute4x64_epi64(_mm256_packs_epi16(
+      _mm256_cmpeq_epi16(first, newline),
+      _mm256_cmpeq_epi16(second, newline)
+    ), 0xD8);
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+    append_line_offsets_for_mask(line_offsets, mask, base_offset + (character - begin));
+  }
+
+  append_line_offsets_sse2(line_offsets, character, end, base_offset + (character - begin));
+}
+
+static bool cpu_supports_avx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return false;
+  __cpuid(info, 1);
+  bool os_saves_ymm_registers = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+  if (!os_saves_ymm_registers) return false;
+  __cpuidex(info, 7, 0);
+  return info[1] & (1 << 5);
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // SUPERSTRING_HAS_SSE2
+
+static Scanner select_scanner() {
+#ifdef SUPERSTRING_HAS_SSE2
+  if (cpu_supports_avx2()) return append_line_offsets_avx2;
+  return append_line_offsets_sse2;
+#else
+  return append_line_offsets_scalar;
+#endif
+}
+
+void append_line_offsets(vector<uint32_t> &line_offsets,
+                         const uint16_t *begin, const uint16_t *end,
+                         uint32_t base_offset) {
+  static const Scanner scanner = select_scanner();
+  scanner(line_offsets, begin, end, base_offset);
+}
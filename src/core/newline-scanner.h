@@ -0,0 +1,14 @@
+#ifndef SUPERSTRING_NEWLINE_SCANNER_H_
+#define SUPERSTRING_NEWLINE_SCANNER_H_
+
+#include <cstdint>
+#include <vector>
+
+// Appends to `line_offsets` the offset following each '\n' between `begin`
+// and `end`, where `begin` is located at `base_offset`. Uses SSE2 where it's
+// available, and AVX2 when the CPU supports it at runtime.
+void append_line_offsets(std::vector<uint32_t> &line_offsets,
+                         const uint16_t *begin, const uint16_t *end,
+                         uint32_t base_offset = 0);
+
+#endif // SUPERSTRING_NEWLINE_SCANNER_H_
@@ -36,6 +36,18 @@ struct Patch::Node {
   uint32_t old_subtree_text_size;
   uint32_t new_subtree_text_size;
 
+  // Unlike the UTF-16 sizes, these are stored even when the texts are, so
+  // that they don't have to be recomputed whenever the subtree changes.
+  EncodedSize old_text_encoded_size;
+  EncodedSize new_text_encoded_size;
+  EncodedSize old_subtree_encoded_size;
+  EncodedSize new_subtree_encoded_size;
+
+  // The longest row of the new text that lies wholly within it, neither its
+  // first row nor its last, which join the text around the change. The row is
+  // relative to the change's new start, and the column is the row's length.
+  Point new_text_longest_interior_row;
+
   Node(
     Node *left,
     Node *right,
@@ -45,7 +57,8 @@ struct Patch::Node {
     Point new_distance_from_left_ancestor,
     unique_ptr<Text> &&old_text,
     unique_ptr<Text> &&new_text,
-    uint32_t old_text_size
+    uint32_t old_text_size,
+    EncodedSize old_text_encoded_size
   ) :
     left{left},
     right{right},
@@ -55,7 +68,10 @@ struct Patch::Node {
     new_distance_from_left_ancestor{new_distance_from_left_ancestor},
     old_text{std::move(old_text)},
     new_text{std::move(new_text)},
-    old_text_size_{old_text_size} {
+    old_text_size_{old_text_size},
+    old_text_encoded_size{this->old_text ? this->old_text->encoded_size() : old_text_encoded_size},
+    new_text_encoded_size{this->new_text ? this->new_text->encoded_size() : EncodedSize()} {
+    compute_new_text_longest_interior_row();
     compute_subtree_text_sizes();
   }
 
@@ -80,6 +96,22 @@ struct Patch::Node {
     } else {
       new_text = nullptr;
     }
+
+    // The encoded size of text that isn't stored is not serialized.
+    if (old_text) old_text_encoded_size = old_text->encoded_size();
+    if (new_text) new_text_encoded_size = new_text->encoded_size();
+    compute_new_text_longest_interior_row();
+  }
+
+  void compute_new_text_longest_interior_row() {
+    new_text_longest_interior_row = Point();
+    if (!new_text) return;
+    for (uint32_t row = 1, end_row = new_text->extent().row; row < end_row; row++) {
+      uint32_t length = new_text->line_length_for_row(row);
+      if (row == 1 || length > new_text_longest_interior_row.column) {
+        new_text_longest_interior_row = Point(row, length);
+      }
+    }
   }
 
   void compute_subtree_text_sizes() {
@@ -87,15 +119,27 @@ struct Patch::Node {
       old_text_size() + left_subtree_old_text_size() + right_subtree_old_text_size();
     new_subtree_text_size =
       new_text_size() + left_subtree_new_text_size() + right_subtree_new_text_size();
+    old_subtree_encoded_size = old_text_encoded_size;
+    new_subtree_encoded_size = new_text_encoded_size;
+    if (left) {
+      old_subtree_encoded_size += left->old_subtree_encoded_size;
+      new_subtree_encoded_size += left->new_subtree_encoded_size;
+    }
+    if (right) {
+      old_subtree_encoded_size += right->old_subtree_encoded_size;
+      new_subtree_encoded_size += right->new_subtree_encoded_size;
+    }
   }
 
-  void set_old_text(optional<Text> &&text, uint32_t old_text_size) {
+  void set_old_text(optional<Text> &&text, uint32_t old_text_size, EncodedSize encoded_size) {
     if (text) {
       old_text = unique_ptr<Text>{new Text{move(*text)}};
       old_text_size_ = 0;
+      old_text_encoded_size = old_text->encoded_size();
     } else {
       old_text = nullptr;
       old_text_size_ = old_text_size;
+      old_text_encoded_size = encoded_size;
     }
   }
 
@@ -114,9 +158,51 @@ struct Patch::Node {
   void set_new_text(optional<Text> &&text) {
     if (text) {
       new_text = unique_ptr<Text>{new Text{move(*text)}};
+      new_text_encoded_size = new_text->encoded_size();
     } else {
       new_text = nullptr;
+      new_text_encoded_size = EncodedSize();
+    }
+    compute_new_text_longest_interior_row();
+  }
+
+  // Replaces the new text between the given positions in place. Typing into
+  // an existing change then reuses the text's storage instead of allocating
+  // a new Text on every keystroke.
+  void splice_new_text(Point start, Point end, const Text &inserted_text) {
+    Text &text = *new_text;
+    start = TextSlice(text).prefix(start).end_position;
+    end = TextSlice(text).prefix(end).end_position;
+    uint32_t start_offset = TextSlice(text).prefix(start).end_offset();
+    uint32_t end_offset = TextSlice(text).prefix(end).end_offset();
+    int64_t size_delta = static_cast<int64_t>(inserted_text.size()) - (end_offset - start_offset);
+    new_text_encoded_size -= EncodedSize::of(text.data() + start_offset, text.data() + end_offset);
+    new_text_encoded_size += inserted_text.encoded_size();
+
+    text.content.erase(text.content.begin() + start_offset, text.content.begin() + end_offset);
+    text.content.insert(
+      text.content.begin() + start_offset,
+      inserted_text.content.begin(),
+      inserted_text.content.end()
+    );
+
+    auto inserted_line_offsets = text.line_offsets.erase(
+      text.line_offsets.begin() + start.row + 1,
+      text.line_offsets.begin() + end.row + 1
+    );
+    inserted_line_offsets = text.line_offsets.insert(
+      inserted_line_offsets,
+      inserted_text.line_offsets.begin() + 1,
+      inserted_text.line_offsets.end()
+    );
+    auto trailing_line_offsets = inserted_line_offsets + (inserted_text.line_offsets.size() - 1);
+    for (auto iter = inserted_line_offsets; iter != trailing_line_offsets; ++iter) {
+      *iter += start_offset;
+    }
+    for (auto iter = trailing_line_offsets; iter != text.line_offsets.end(); ++iter) {
+      *iter += size_delta;
     }
+    compute_new_text_longest_interior_row();
   }
 
   uint32_t new_text_size() const {
@@ -144,8 +230,8 @@ struct Patch::Node {
     }
   }
 
-  Node *copy() {
-    auto result = new Node{
+  Node *copy(SlabAllocator<Node> &allocator) {
+    auto result = allocator.create(
       left,
       right,
       old_extent,
@@ -155,14 +241,17 @@ struct Patch::Node {
       old_text ? unique_ptr<Text>(new Text(*old_text)) : nullptr,
       new_text ? unique_ptr<Text>(new Text(*new_text)) : nullptr,
       old_text_size_,
-    };
+      old_text_encoded_size
+    );
     result->old_subtree_text_size = old_subtree_text_size;
     result->new_subtree_text_size = new_subtree_text_size;
+    result->old_subtree_encoded_size = old_subtree_encoded_size;
+    result->new_subtree_encoded_size = new_subtree_encoded_size;
     return result;
   }
 
-  Node *invert() {
-    auto result = new Node{
+  Node *invert(SlabAllocator<Node> &allocator) {
+    auto result = allocator.create(
       left,
       right,
       new_extent,
@@ -171,10 +260,13 @@ struct Patch::Node {
       old_distance_from_left_ancestor,
       new_text ? unique_ptr<Text>(new Text(*new_text)) : nullptr,
       old_text ? unique_ptr<Text>(new Text(*old_text)) : nullptr,
-      new_text ? new_text->size() : 0
-    };
+      new_text ? new_text->size() : 0,
+      new_text_encoded_size
+    );
     result->old_subtree_text_size = new_subtree_text_size;
     result->new_subtree_text_size = old_subtree_text_size;
+    result->old_subtree_encoded_size = new_subtree_encoded_size;
+    result->new_subtree_encoded_size = old_subtree_encoded_size;
     return result;
   }
 
@@ -324,10 +416,6 @@ Patch::Patch(Patch &&other)
   *this = move(other);
 }
 
-Patch::Patch(Node *root, uint32_t change_count, bool merges_adjacent_changes)
-  : root{root}, change_count{change_count},
-    merges_adjacent_changes{merges_adjacent_changes} {}
-
 Patch::Patch(const vector<const Patch *> &patches_to_compose) : Patch() {
   bool left_to_right = true;
   for (const Patch *patch : patches_to_compose) {
@@ -349,20 +437,20 @@ Patch::Patch(Deserializer &input) :
   if (change_count == 0) return;
 
   node_stack.reserve(change_count);
-  root = new Node(input);
+  root = node_allocator.create(input);
   Node *node = root, *next_node = nullptr;
 
   for (uint32_t i = 1; i < change_count;) {
     switch (input.read<uint32_t>()) {
     case Left:
-      next_node = new Node(input);
+      next_node = node_allocator.create(input);
       node->left = next_node;
       node_stack.push_back(node);
       node = next_node;
       i++;
       break;
     case Right:
-      next_node = new Node(input);
+      next_node = node_allocator.create(input);
       node->right = next_node;
       node_stack.push_back(node);
       node = next_node;
@@ -374,7 +462,8 @@ Patch::Patch(Deserializer &input) :
       node_stack.pop_back();
       break;
     default:
-      delete root;
+      delete_node(&root);
+      change_count = 0;
       return;
     }
   }
@@ -387,6 +476,7 @@ Patch::Patch(Deserializer &input) :
 
 Patch &Patch::operator=(Patch &&other) {
   std::swap(root, other.root);
+  node_allocator.swap(other.node_allocator);
   std::swap(left_ancestor_stack, other.left_ancestor_stack);
   std::swap(node_stack, other.node_stack);
   std::swap(change_count, other.change_count);
@@ -398,7 +488,7 @@ Patch::~Patch() {
   if (root) delete_node(&root);
 }
 
-void Patch::serialize(Serializer &output) {
+void Patch::serialize(Serializer &output) const {
   output.append(SERIALIZATION_VERSION);
   output.append(change_count);
 
@@ -406,7 +496,7 @@ void Patch::serialize(Serializer &output) {
   root->serialize(output);
 
   Node *node = root;
-  node_stack.clear();
+  vector<Node *> node_stack;
   int previous_node_child_index = -1;
 
   while (node) {
@@ -434,52 +524,52 @@ void Patch::serialize(Serializer &output) {
   }
 }
 
-Patch Patch::copy() {
-  Node *new_root = nullptr;
+Patch Patch::copy() const {
+  Patch result{merges_adjacent_changes};
   if (root) {
-    new_root = root->copy();
-    node_stack.clear();
-    node_stack.push_back(new_root);
+    result.root = root->copy(result.node_allocator);
+    result.change_count = change_count;
+    vector<Node *> node_stack{result.root};
 
     while (!node_stack.empty()) {
       Node *node = node_stack.back();
       node_stack.pop_back();
       if (node->left) {
-        node->left = node->left->copy();
+        node->left = node->left->copy(result.node_allocator);
         node_stack.push_back(node->left);
       }
       if (node->right) {
-        node->right = node->right->copy();
+        node->right = node->right->copy(result.node_allocator);
         node_stack.push_back(node->right);
       }
     }
   }
 
-  return Patch{new_root, change_count, merges_adjacent_changes};
+  return result;
 }
 
-Patch Patch::invert() {
-  Node *inverted_root = nullptr;
+Patch Patch::invert() const {
+  Patch result{merges_adjacent_changes};
   if (root) {
-    inverted_root = root->invert();
-    node_stack.clear();
-    node_stack.push_back(inverted_root);
+    result.root = root->invert(result.node_allocator);
+    result.change_count = change_count;
+    vector<Node *> node_stack{result.root};
 
     while (!node_stack.empty()) {
       Node *node = node_stack.back();
       node_stack.pop_back();
       if (node->left) {
-        node->left = node->left->invert();
+        node->left = node->left->invert(result.node_allocator);
         node_stack.push_back(node->left);
       }
       if (node->right) {
-        node->right = node->right->invert();
+        node->right = node->right->invert(result.node_allocator);
         node_stack.push_back(node->right);
       }
     }
   }
 
-  return Patch{inverted_root, change_count, merges_adjacent_changes};
+  return result;
 }
 
 // Mutations
@@ -487,14 +577,14 @@ Patch Patch::invert() {
 void Patch::splice(Point new_splice_start,
                    Point new_deletion_extent, Point new_insertion_extent,
                    optional<Text> &&deleted_text, optional<Text> &&inserted_text,
-                   uint32_t deleted_text_size) {
+                   uint32_t deleted_text_size, EncodedSize deleted_text_encoded_size) {
   if (new_deletion_extent.is_zero() && new_insertion_extent.is_zero()) return;
 
   if (!root) {
     root = build_node(nullptr, nullptr, new_splice_start, new_splice_start,
                      new_deletion_extent, new_insertion_extent,
                      move(deleted_text), move(inserted_text),
-                     deleted_text_size);
+                     deleted_text_size, deleted_text_encoded_size);
     return;
   }
 
@@ -506,8 +596,11 @@ void Patch::splice(Point new_splice_start,
       compute_old_text(move(deleted_text), new_splice_start, new_deletion_end);
 
   uint32_t old_text_size = 0;
+  EncodedSize old_text_encoded_size;
   if (!old_text) {
-    old_text_size = compute_old_text_size(deleted_text_size, new_splice_start, new_deletion_end);
+    old_text_size = compute_old_text_size(deleted_text_size, deleted_text_encoded_size,
+                                          new_splice_start, new_deletion_end,
+                                          &old_text_encoded_size);
   }
 
   Node *upper_bound =
@@ -555,7 +648,13 @@ void Patch::splice(Point new_splice_start,
       upper_bound->old_distance_from_left_ancestor = lower_bound_old_start;
       upper_bound->new_distance_from_left_ancestor = lower_bound_new_start;
 
-      if (inserted_text && lower_bound->new_text && upper_bound->new_text) {
+      if (inserted_text && lower_bound == upper_bound && upper_bound->new_text) {
+        upper_bound->splice_new_text(
+          new_extent_prefix,
+          new_deletion_end.traversal(upper_bound_new_start),
+          *inserted_text
+        );
+      } else if (inserted_text && lower_bound->new_text && upper_bound->new_text) {
         TextSlice new_text_prefix =
             TextSlice(*lower_bound->new_text).prefix(new_extent_prefix);
         TextSlice new_text_suffix = TextSlice(*upper_bound->new_text).suffix(
@@ -567,7 +666,7 @@ void Patch::splice(Point new_splice_start,
         upper_bound->set_new_text(optional<Text>{});
       }
 
-      upper_bound->set_old_text(move(old_text), old_text_size);
+      upper_bound->set_old_text(move(old_text), old_text_size, old_text_encoded_size);
 
       if (lower_bound == upper_bound) {
         if (root->old_extent.is_zero() && root->new_extent.is_zero()) {
@@ -592,16 +691,16 @@ void Patch::splice(Point new_splice_start,
           new_insertion_extent.traverse(new_extent_suffix);
 
       if (inserted_text && upper_bound->new_text) {
-        TextSlice new_text_suffix = TextSlice(*upper_bound->new_text).suffix(
-            new_deletion_end.traversal(upper_bound_new_start));
-        upper_bound->set_new_text(
-          Text::concat(*inserted_text, new_text_suffix)
+        upper_bound->splice_new_text(
+          Point(),
+          new_deletion_end.traversal(upper_bound_new_start),
+          *inserted_text
         );
       } else {
         upper_bound->set_new_text(optional<Text>{});
       }
 
-      upper_bound->set_old_text(move(old_text), old_text_size);
+      upper_bound->set_old_text(move(old_text), old_text_size, old_text_encoded_size);
 
       delete_node(&lower_bound->right);
       if (upper_bound->left != lower_bound) {
@@ -624,14 +723,16 @@ void Patch::splice(Point new_splice_start,
       lower_bound->new_extent =
           new_extent_prefix.traverse(new_insertion_extent);
       if (inserted_text && lower_bound->new_text) {
-        TextSlice new_text_prefix =
-            TextSlice(*lower_bound->new_text).prefix(new_extent_prefix);
-        lower_bound->set_new_text(Text::concat(new_text_prefix, *inserted_text));
+        lower_bound->splice_new_text(
+          new_extent_prefix,
+          lower_bound->new_text->extent(),
+          *inserted_text
+        );
       } else {
         lower_bound->set_new_text(optional<Text>{});
       }
 
-      lower_bound->set_old_text(move(old_text), old_text_size);
+      lower_bound->set_old_text(move(old_text), old_text_size, old_text_encoded_size);
 
       delete_node(&lower_bound->right);
       rotate_node_right(lower_bound, upper_bound, nullptr);
@@ -648,7 +749,7 @@ void Patch::splice(Point new_splice_start,
         root = build_node(upper_bound->left, upper_bound, upper_bound_old_start,
                          upper_bound_new_start, Point(),
                          new_insertion_extent, move(old_text),
-                         move(inserted_text), old_text_size);
+                         move(inserted_text), old_text_size, old_text_encoded_size);
 
         upper_bound->left = nullptr;
         upper_bound->old_distance_from_left_ancestor = Point();
@@ -665,7 +766,7 @@ void Patch::splice(Point new_splice_start,
         root = build_node(
             lower_bound, upper_bound, old_splice_start, new_splice_start,
             old_deletion_end.traversal(old_splice_start), new_insertion_extent,
-            move(old_text), move(inserted_text), old_text_size);
+            move(old_text), move(inserted_text), old_text_size, old_text_encoded_size);
 
         delete_node(&lower_bound->right);
         upper_bound->left = nullptr;
@@ -700,14 +801,16 @@ void Patch::splice(Point new_splice_start,
       lower_bound->new_extent =
           new_insertion_end.traversal(lower_bound_new_start);
       if (inserted_text && lower_bound->new_text) {
-        TextSlice new_text_prefix = TextSlice(*lower_bound->new_text).prefix(
-            new_splice_start.traversal(lower_bound_new_start));
-        lower_bound->set_new_text(Text::concat(new_text_prefix, *inserted_text));
+        lower_bound->splice_new_text(
+          new_splice_start.traversal(lower_bound_new_start),
+          lower_bound->new_text->extent(),
+          *inserted_text
+        );
       } else {
         lower_bound->set_new_text(optional<Text>{});
       }
 
-      lower_bound->set_old_text(move(old_text), old_text_size);
+      lower_bound->set_old_text(move(old_text), old_text_size, old_text_encoded_size);
     } else {
       Point old_splice_start = lower_bound_old_end.traverse(
           new_splice_start.traversal(lower_bound_new_end));
@@ -715,7 +818,7 @@ void Patch::splice(Point new_splice_start,
           build_node(lower_bound, nullptr, old_splice_start, new_splice_start,
                     old_deletion_end.traversal(old_splice_start),
                     new_insertion_extent, move(old_text), move(inserted_text),
-                    old_text_size);
+                    old_text_size, old_text_encoded_size);
     }
 
   } else if (upper_bound) {
@@ -749,20 +852,22 @@ void Patch::splice(Point new_splice_start,
           upper_bound_new_end.traversal(new_deletion_end));
 
       if (inserted_text && upper_bound->new_text) {
-        TextSlice new_text_suffix = TextSlice(*upper_bound->new_text).suffix(
-            new_deletion_end.traversal(upper_bound_new_start));
-        upper_bound->set_new_text(Text::concat(*inserted_text, new_text_suffix));
+        upper_bound->splice_new_text(
+          Point(),
+          new_deletion_end.traversal(upper_bound_new_start),
+          *inserted_text
+        );
       } else {
         upper_bound->set_new_text(optional<Text>{});
       }
 
-      upper_bound->set_old_text(move(old_text), old_text_size);
+      upper_bound->set_old_text(move(old_text), old_text_size, old_text_encoded_size);
     } else {
       root =
           build_node(nullptr, upper_bound, new_splice_start, new_splice_start,
                     old_deletion_end.traversal(new_splice_start),
                     new_insertion_extent, move(old_text), move(inserted_text),
-                    old_text_size);
+                    old_text_size, old_text_encoded_size);
       Point distance_from_end_of_root_to_start_of_upper_bound =
           upper_bound_new_start.traversal(new_deletion_end);
       upper_bound->old_distance_from_left_ancestor =
@@ -780,7 +885,7 @@ void Patch::splice(Point new_splice_start,
     root = build_node(nullptr, nullptr, new_splice_start, new_splice_start,
                      old_deletion_end.traversal(new_splice_start),
                      new_insertion_extent, move(old_text), move(inserted_text),
-                     old_text_size);
+                     old_text_size, old_text_encoded_size);
   }
 
   if (lower_bound) lower_bound->compute_subtree_text_sizes();
@@ -865,15 +970,19 @@ void Patch::splice_old(Point old_splice_start, Point old_deletion_extent,
           upper_bound->old_text = nullptr;
           upper_bound->old_text_size_ += lower_bound->old_text_size_;
         }
+        upper_bound->old_text_encoded_size += lower_bound->old_text_encoded_size;
 
         upper_bound->new_extent =
             lower_bound->new_extent.traverse(upper_bound->new_extent);
         if (lower_bound->new_text && upper_bound->new_text) {
           lower_bound->new_text->append(*upper_bound->new_text);
           std::swap(upper_bound->new_text, lower_bound->new_text);
+          upper_bound->new_text_encoded_size += lower_bound->new_text_encoded_size;
         } else {
           upper_bound->new_text = nullptr;
+          upper_bound->new_text_encoded_size = EncodedSize();
         }
+        upper_bound->compute_new_text_longest_interior_row();
 
         upper_bound->left = lower_bound->left;
         lower_bound->left = nullptr;
@@ -890,14 +999,30 @@ void Patch::splice_old(Point old_splice_start, Point old_deletion_extent,
 }
 
 void Patch::combine(const Patch &other, bool left_to_right) {
-  auto changes = other.get_changes();
+  combine_changes(other.get_changes(), left_to_right, false);
+}
+
+void Patch::combine(Patch &&other, bool left_to_right) {
+  combine_changes(other.get_changes(), left_to_right, true);
+}
+
+// When `take_texts` is true, the changes' texts are moved out of the other
+// patch rather than copied, leaving that patch's texts empty.
+void Patch::combine_changes(const vector<Change> &changes, bool left_to_right, bool take_texts) {
+  auto text_for_change = [take_texts](Text *text) {
+    if (!text) return optional<Text>{};
+    if (take_texts) return optional<Text>{move(*text)};
+    return optional<Text>{*text};
+  };
+
   if (left_to_right) {
     for (auto iter = changes.begin(), end = changes.end(); iter != end; ++iter) {
       splice(iter->new_start, iter->old_end.traversal(iter->old_start),
              iter->new_end.traversal(iter->new_start),
-             iter->old_text ? *iter->old_text : optional<Text>{},
-             iter->new_text ? *iter->new_text : optional<Text>{},
-             iter->old_text_size);
+             text_for_change(iter->old_text),
+             text_for_change(iter->new_text),
+             iter->old_text_size,
+             iter->old_text_encoded_size);
       remove_noop_change();
     }
   } else {
@@ -905,16 +1030,20 @@ void Patch::combine(const Patch &other, bool left_to_right) {
          ++iter) {
       splice(iter->old_start, iter->old_end.traversal(iter->old_start),
              iter->new_end.traversal(iter->new_start),
-             iter->old_text ? *iter->old_text : optional<Text>{},
-             iter->new_text ? *iter->new_text : optional<Text>{},
-             iter->old_text_size);
+             text_for_change(iter->old_text),
+             text_for_change(iter->new_text),
+             iter->old_text_size,
+             iter->old_text_encoded_size);
       remove_noop_change();
     }
   }
 }
 
+// Once the tree is empty, the blocks that held its nodes are released too, so
+// that a patch that once held many changes doesn't keep that memory forever.
 void Patch::clear() {
   if (root) delete_node(&root);
+  node_allocator = SlabAllocator<Node>();
 }
 
 void Patch::rebalance() {
@@ -980,7 +1109,7 @@ optional<Change> Patch::get_bounds() const {
     old_start, old_end,
     new_start, new_end,
     nullptr, nullptr,
-    0, 0, 0
+    0, 0, 0, EncodedSize(), Point()
   };
 }
 
@@ -1057,6 +1186,133 @@ Point Patch::new_position_for_new_offset(uint32_t target_offset,
   );
 }
 
+// The encoded size of the text between the start of the unchanged text and a
+// position only depends on the change preceding that position, so this visits
+// one path of the tree and resolves one position in the old text.
+EncodedSize Patch::new_encoded_size_for_new_position(Point target,
+                                                     function<EncodedSize(Point)> old_encoded_size_for_old_position) const {
+  const Node *node = root;
+  const Node *found_node = nullptr;
+  Point left_ancestor_old_end, left_ancestor_new_end;
+  EncodedSize left_ancestor_old_size, left_ancestor_new_size;
+  Point found_node_old_start, found_node_new_start;
+  EncodedSize found_node_preceding_old_size, found_node_preceding_new_size;
+
+  while (node) {
+    Point node_old_start = left_ancestor_old_end.traverse(node->old_distance_from_left_ancestor);
+    Point node_new_start = left_ancestor_new_end.traverse(node->new_distance_from_left_ancestor);
+    if (node_new_start <= target) {
+      found_node = node;
+      found_node_old_start = node_old_start;
+      found_node_new_start = node_new_start;
+      found_node_preceding_old_size = left_ancestor_old_size;
+      found_node_preceding_new_size = left_ancestor_new_size;
+      if (node->left) {
+        found_node_preceding_old_size += node->left->old_subtree_encoded_size;
+        found_node_preceding_new_size += node->left->new_subtree_encoded_size;
+      }
+      if (node->right) {
+        left_ancestor_old_end = node_old_start.traverse(node->old_extent);
+        left_ancestor_new_end = node_new_start.traverse(node->new_extent);
+        left_ancestor_old_size = found_node_preceding_old_size + node->old_text_encoded_size;
+        left_ancestor_new_size = found_node_preceding_new_size + node->new_text_encoded_size;
+        node = node->right;
+      } else {
+        break;
+      }
+    } else {
+      if (node->left) {
+        node = node->left;
+      } else {
+        break;
+      }
+    }
+  }
+
+  if (!found_node) return old_encoded_size_for_old_position(target);
+
+  Point found_node_new_end = found_node_new_start.traverse(found_node->new_extent);
+  if (target < found_node_new_end) {
+    EncodedSize new_text_prefix_size;
+    if (found_node->new_text) {
+      const Text &new_text = *found_node->new_text;
+      uint32_t offset = new_text.offset_for_position(target.traversal(found_node_new_start));
+      new_text_prefix_size = EncodedSize::of(new_text.data(), new_text.data() + offset);
+    }
+    return old_encoded_size_for_old_position(found_node_old_start) +
+      found_node_preceding_new_size + new_text_prefix_size -
+      found_node_preceding_old_size;
+  } else {
+    Point found_node_old_end = found_node_old_start.traverse(found_node->old_extent);
+    return old_encoded_size_for_old_position(found_node_old_end.traverse(target.traversal(found_node_new_end))) +
+      found_node_preceding_new_size + found_node->new_text_encoded_size -
+      found_node_preceding_old_size - found_node->old_text_encoded_size;
+  }
+}
+
+Point Patch::new_position_for_new_encoded_offset(uint32_t EncodedSize::*unit, uint32_t target_offset,
+                                                 function<EncodedSize(Point)> old_encoded_size_for_old_position,
+                                                 function<Point(uint32_t)> old_position_for_old_encoded_offset) const {
+  const Node *node = root;
+  Point left_ancestor_old_end, left_ancestor_new_end;
+  EncodedSize left_ancestor_old_size, left_ancestor_new_size;
+  Point preceding_new_position, preceding_old_position;
+  uint32_t preceding_old_offset = 0, preceding_new_offset = 0;
+
+  while (node) {
+    Point node_old_start = left_ancestor_old_end.traverse(node->old_distance_from_left_ancestor);
+    Point node_new_start = left_ancestor_new_end.traverse(node->new_distance_from_left_ancestor);
+    EncodedSize node_preceding_old_size = left_ancestor_old_size;
+    EncodedSize node_preceding_new_size = left_ancestor_new_size;
+    if (node->left) {
+      node_preceding_old_size += node->left->old_subtree_encoded_size;
+      node_preceding_new_size += node->left->new_subtree_encoded_size;
+    }
+    uint32_t node_old_start_offset = old_encoded_size_for_old_position(node_old_start).*unit;
+    uint32_t node_new_start_offset = node_old_start_offset -
+      node_preceding_old_size.*unit +
+      node_preceding_new_size.*unit;
+    uint32_t node_new_end_offset = node_new_start_offset + node->new_text_encoded_size.*unit;
+    uint32_t node_old_end_offset = node_old_start_offset + node->old_text_encoded_size.*unit;
+
+    if (node_new_end_offset <= target_offset) {
+      preceding_old_position = node_old_start.traverse(node->old_extent);
+      preceding_new_position = node_new_start.traverse(node->new_extent);
+      preceding_old_offset = node_old_end_offset;
+      preceding_new_offset = node_new_end_offset;
+      if (node->right) {
+        left_ancestor_old_end = preceding_old_position;
+        left_ancestor_new_end = preceding_new_position;
+        left_ancestor_old_size = node_preceding_old_size + node->old_text_encoded_size;
+        left_ancestor_new_size = node_preceding_new_size + node->new_text_encoded_size;
+        node = node->right;
+      } else {
+        break;
+      }
+    } else if (node_new_start_offset <= target_offset) {
+      if (!node->new_text) return node_new_start;
+      const Text &new_text = *node->new_text;
+      uint32_t offset = EncodedSize::prefix_size(
+        new_text.data(), new_text.data() + new_text.size(),
+        unit, target_offset - node_new_start_offset
+      );
+      return node_new_start.traverse(new_text.position_for_offset(offset));
+    } else {
+      if (node->left) {
+        node = node->left;
+      } else {
+        break;
+      }
+    }
+  }
+
+  return preceding_new_position.traverse(
+    old_position_for_old_encoded_offset(
+      preceding_old_offset + (target_offset - preceding_new_offset)
+    ).traversal(preceding_old_position)
+  );
+}
+
 // Splaying reads
 
 vector<Change> Patch::grab_changes_in_old_range(Point start, Point end) {
@@ -1101,6 +1357,30 @@ std::string Patch::get_json() const {
   return result.str();
 }
 
+Patch::MemoryUsage Patch::memory_usage() const {
+  MemoryUsage result{
+    change_count,
+    node_allocator.memory_usage() +
+      node_stack.capacity() * sizeof(Node *) +
+      left_ancestor_stack.capacity() * sizeof(PositionStackEntry),
+    0,
+    0
+  };
+
+  vector<Node *> node_stack;
+  if (root) node_stack.push_back(root);
+  while (!node_stack.empty()) {
+    Node *node = node_stack.back();
+    node_stack.pop_back();
+    if (node->old_text) result.old_text_bytes += sizeof(Text) + node->old_text->memory_usage();
+    if (node->new_text) result.new_text_bytes += sizeof(Text) + node->new_text->memory_usage();
+    if (node->left) node_stack.push_back(node->left);
+    if (node->right) node_stack.push_back(node->right);
+  }
+
+  return result;
+}
+
 // Private - mutations
 
 void Patch::splay_node(Node *node) {
@@ -1221,6 +1501,8 @@ void Patch::delete_root() {
 
     parent->old_subtree_text_size -= node->old_text_size();
     parent->new_subtree_text_size -= node->new_text_size();
+    parent->old_subtree_encoded_size -= node->old_text_encoded_size;
+    parent->new_subtree_encoded_size -= node->new_text_encoded_size;
   }
 }
 
@@ -1279,9 +1561,12 @@ optional<Text> Patch::compute_old_text(optional<Text> &&deleted_text,
 }
 
 uint32_t Patch::compute_old_text_size(uint32_t deleted_text_size,
+                                      EncodedSize deleted_text_encoded_size,
                                       Point new_splice_start,
-                                      Point new_deletion_end) {
+                                      Point new_deletion_end,
+                                      EncodedSize *old_text_encoded_size) {
   uint32_t old_text_size = deleted_text_size;
+  *old_text_encoded_size = deleted_text_encoded_size;
   auto overlapping_changes = grab_changes_in_range<NewCoordinates>(
     new_splice_start,
     new_deletion_end,
@@ -1289,7 +1574,10 @@ uint32_t Patch::compute_old_text_size(uint32_t deleted_text_size,
   );
 
   for (const Change &change : overlapping_changes) {
-    if (!change.new_text) return 0;
+    if (!change.new_text) {
+      *old_text_encoded_size = EncodedSize();
+      return 0;
+    }
 
     TextSlice overlapping_new_text = TextSlice(*change.new_text);
     if (new_deletion_end < change.new_end) {
@@ -1301,6 +1589,9 @@ uint32_t Patch::compute_old_text_size(uint32_t deleted_text_size,
 
     old_text_size -= overlapping_new_text.size();
     old_text_size += change.old_text_size;
+    *old_text_encoded_size -= EncodedSize::of(overlapping_new_text.data(),
+                                              overlapping_new_text.data() + overlapping_new_text.size());
+    *old_text_encoded_size += change.old_text_encoded_size;
   }
 
   return old_text_size;
@@ -1311,19 +1602,20 @@ Patch::Node *Patch::build_node(Node *left, Node *right,
                        Point new_distance_from_left_ancestor,
                        Point old_extent, Point new_extent,
                        optional<Text> &&old_text, optional<Text> &&new_text,
-                       uint32_t old_text_size) {
+                       uint32_t old_text_size, EncodedSize old_text_encoded_size) {
   change_count++;
-  return new Node{
+  return node_allocator.create(
     left,
     right,
     old_extent,
     new_extent,
     old_distance_from_left_ancestor,
     new_distance_from_left_ancestor,
-    old_text ? unique_ptr<Text>{new Text(*old_text)} : nullptr,
-    new_text ? unique_ptr<Text>{new Text(*new_text)} : nullptr,
-    old_text_size
-  };
+    old_text ? unique_ptr<Text>{new Text(move(*old_text))} : nullptr,
+    new_text ? unique_ptr<Text>{new Text(move(*new_text))} : nullptr,
+    old_text_size,
+    old_text_encoded_size
+  );
 }
 
 void Patch::delete_node(Node **node_to_delete) {
@@ -1338,7 +1630,7 @@ void Patch::delete_node(Node **node_to_delete) {
         node_stack.push_back(node->left);
       if (node->right)
         node_stack.push_back(node->right);
-      delete node;
+      node_allocator.destroy(node);
       change_count--;
     }
 
@@ -1512,6 +1804,8 @@ vector<Patch::Change> Patch::get_changes_in_range(Point start, Point end, bool i
       preceding_old_text_size,
       preceding_new_text_size,
       old_text_size,
+      node->old_text_encoded_size,
+      node->new_text_longest_interior_row,
     };
     result.push_back(change);
 
@@ -1590,7 +1884,9 @@ optional<Patch::Change> Patch::get_change_starting_before_position(Point target)
       found_node->new_text.get(),
       found_node_left_ancestor_info.total_old_text_size + found_node->left_subtree_old_text_size(),
       found_node_left_ancestor_info.total_new_text_size + found_node->left_subtree_new_text_size(),
-      found_node->old_text_size()
+      found_node->old_text_size(),
+      found_node->old_text_encoded_size,
+      found_node->new_text_longest_interior_row
     };
   } else {
     return optional<Change>{};
@@ -1640,7 +1936,9 @@ optional<Patch::Change> Patch::get_change_ending_after_position(Point target) co
       found_node->new_text.get(),
       found_node_left_ancestor_info.total_old_text_size + found_node->left_subtree_old_text_size(),
       found_node_left_ancestor_info.total_new_text_size + found_node->left_subtree_new_text_size(),
-      found_node->old_text_size()
+      found_node->old_text_size(),
+      found_node->old_text_encoded_size,
+      found_node->new_text_longest_interior_row
     };
   } else {
     return optional<Change>{};
@@ -1696,6 +1994,8 @@ vector<Change> Patch::grab_changes_in_range(Point start, Point end, bool inclusi
       preceding_old_text_size,
       preceding_new_text_size,
       old_text_size,
+      node->old_text_encoded_size,
+      node->new_text_longest_interior_row,
     };
 
     if (inclusive) {
@@ -1858,6 +2158,8 @@ Change Patch::change_for_root_node() {
     preceding_old_text_size,
     preceding_new_text_size,
     old_text_size,
+    root->old_text_encoded_size,
+    root->new_text_longest_interior_row,
   };
 }
 
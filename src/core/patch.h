@@ -4,6 +4,7 @@
 #include "optional.h"
 #include "point.h"
 #include "serializer.h"
+#include "slab-allocator.h"
 #include "text.h"
 #include <memory>
 #include <vector>
@@ -16,6 +17,7 @@ class Patch {
   struct PositionStackEntry;
 
   Node *root;
+  SlabAllocator<Node> node_allocator;
   std::vector<Node *> node_stack;
   std::vector<PositionStackEntry> left_ancestor_stack;
   uint32_t change_count;
@@ -32,6 +34,15 @@ public:
     uint32_t preceding_old_text_size;
     uint32_t preceding_new_text_size;
     uint32_t old_text_size;
+    EncodedSize old_text_encoded_size;
+    Point new_text_longest_interior_row;
+  };
+
+  struct MemoryUsage {
+    size_t node_count;
+    size_t node_bytes;
+    size_t old_text_bytes;
+    size_t new_text_bytes;
   };
 
   // Construction and destruction
@@ -41,19 +52,21 @@ public:
   Patch(Deserializer &input);
   Patch &operator=(Patch &&);
   ~Patch();
-  void serialize(Serializer &serializer);
+  void serialize(Serializer &serializer) const;
 
-  Patch copy();
-  Patch invert();
+  Patch copy() const;
+  Patch invert() const;
 
   // Mutations
   void splice(Point new_splice_start,
               Point new_deletion_extent, Point new_insertion_extent,
               optional<Text> &&deleted_text = optional<Text> {},
               optional<Text> &&inserted_text = optional<Text> {},
-              uint32_t deleted_text_size = 0);
+              uint32_t deleted_text_size = 0,
+              EncodedSize deleted_text_encoded_size = EncodedSize());
   void splice_old(Point start, Point deletion_extent, Point insertion_extent);
   void combine(const Patch &other, bool left_to_right = true);
+  void combine(Patch &&other, bool left_to_right = true);
   void clear();
   void rebalance();
 
@@ -69,6 +82,11 @@ public:
   Point new_position_for_new_offset(uint32_t new_offset,
                                     std::function<uint32_t(Point)> old_offset_for_old_position,
                                     std::function<Point(uint32_t)> old_position_for_old_offset) const;
+  EncodedSize new_encoded_size_for_new_position(Point new_position,
+                                                std::function<EncodedSize(Point)> old_encoded_size_for_old_position) const;
+  Point new_position_for_new_encoded_offset(uint32_t EncodedSize::*unit, uint32_t new_encoded_offset,
+                                            std::function<EncodedSize(Point)> old_encoded_size_for_old_position,
+                                            std::function<Point(uint32_t)> old_position_for_old_encoded_offset) const;
 
   // Splaying reads
   std::vector<Change> grab_changes_in_old_range(Point start, Point end);
@@ -80,10 +98,9 @@ public:
   // Debugging
   std::string get_dot_graph() const;
   std::string get_json() const;
+  MemoryUsage memory_usage() const;
 
 private:
-  Patch(Node *root, uint32_t change_count, bool merges_adjacent_changes);
-
   template <typename CoordinateSpace>
   std::vector<Change> get_changes_in_range(Point, Point, bool inclusive) const;
 
@@ -112,9 +129,10 @@ private:
   Node *splay_node_ending_after(Point target, optional<Point> exclusive_lower_bound);
 
   Change change_for_root_node();
+  void combine_changes(const std::vector<Change> &, bool left_to_right, bool take_texts);
 
   optional<Text> compute_old_text(optional<Text> &&, Point, Point);
-  uint32_t compute_old_text_size(uint32_t, Point, Point);
+  uint32_t compute_old_text_size(uint32_t, EncodedSize, Point, Point, EncodedSize *);
 
   void splay_node(Node *);
   void rotate_node_right(Node *, Node *, Node *);
@@ -122,7 +140,8 @@ private:
   void delete_root();
   void perform_rebalancing_rotations(uint32_t);
   Node *build_node(Node *, Node *, Point, Point, Point, Point,
-                  optional<Text> &&, optional<Text> &&, uint32_t old_text_size);
+                  optional<Text> &&, optional<Text> &&, uint32_t old_text_size,
+                  EncodedSize old_text_encoded_size);
   void delete_node(Node **);
   void remove_noop_change();
 };
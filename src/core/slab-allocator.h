@@ -0,0 +1,85 @@
+#ifndef SUPERSTRING_SLAB_ALLOCATOR_H
+#define SUPERSTRING_SLAB_ALLOCATOR_H
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Allocates objects of a single type from a list of geometrically growing
+// blocks. Destroyed objects are threaded onto a free list and their slots are
+// reused by subsequent allocations. All blocks are released together when the
+// allocator is destroyed, so every object must be destroyed before that.
+template <typename T> class SlabAllocator {
+  union Slot {
+    Slot *next_free_slot;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  static const size_t MIN_BLOCK_SIZE = 16;
+  static const size_t MAX_BLOCK_SIZE = 1024;
+
+  std::vector<std::unique_ptr<Slot[]>> blocks;
+  Slot *free_slot;
+  size_t last_block_size;
+  size_t last_block_used;
+  size_t slot_count;
+
+public:
+  SlabAllocator() : free_slot{nullptr}, last_block_size{0}, last_block_used{0}, slot_count{0} {}
+  SlabAllocator(const SlabAllocator &) = delete;
+  SlabAllocator &operator=(const SlabAllocator &) = delete;
+
+  SlabAllocator(SlabAllocator &&other) : SlabAllocator() {
+    swap(other);
+  }
+
+  SlabAllocator &operator=(SlabAllocator &&other) {
+    swap(other);
+    return *this;
+  }
+
+  void swap(SlabAllocator &other) {
+    std::swap(blocks, other.blocks);
+    std::swap(free_slot, other.free_slot);
+    std::swap(last_block_size, other.last_block_size);
+    std::swap(last_block_used, other.last_block_used);
+    std::swap(slot_count, other.slot_count);
+  }
+
+  // The number of bytes allocated for blocks, including free slots.
+  size_t memory_usage() const {
+    return slot_count * sizeof(Slot) + blocks.capacity() * sizeof(blocks[0]);
+  }
+
+  template <typename... Args> T *create(Args &&... args) {
+    Slot *slot;
+    if (free_slot) {
+      slot = free_slot;
+      free_slot = slot->next_free_slot;
+    } else {
+      if (last_block_used == last_block_size) {
+        last_block_size = last_block_size == 0
+          ? MIN_BLOCK_SIZE
+          : std::min(last_block_size * 2, MAX_BLOCK_SIZE);
+        blocks.emplace_back(new Slot[last_block_size]);
+        last_block_used = 0;
+        slot_count += last_block_size;
+      }
+      slot = &blocks.back()[last_block_used++];
+    }
+    return new (&slot->storage) T(std::forward<Args>(args)...);
+  }
+
+  void destroy(T *object) {
+    object->~T();
+    Slot *slot = reinterpret_cast<Slot *>(object);
+    slot->next_free_slot = free_slot;
+    free_slot = slot;
+  }
+};
+
+template <typename T> const size_t SlabAllocator<T>::MIN_BLOCK_SIZE;
+template <typename T> const size_t SlabAllocator<T>::MAX_BLOCK_SIZE;
+
+#endif // SUPERSTRING_SLAB_ALLOCATOR_H
@@ -1,12 +1,15 @@
 #include "text-slice.h"
 #include "text-buffer.h"
 #include "regex.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <vector>
 #include <sstream>
 
 using std::equal;
 using std::move;
+using std::pair;
 using std::string;
 using std::vector;
 using std::u16string;
@@ -16,36 +19,98 @@ using MatchResult = Regex::MatchResult;
 
 uint32_t TextBuffer::MAX_CHUNK_SIZE_TO_COPY = 1024;
 
+// When a new layer is pushed while snapshots are alive, reads from the top
+// layer may have to pass through the patches of every layer that a snapshot
+// still references. Once that path gets longer than this many layers, or
+// spans more than this many changes, the text is materialized into a
+// checkpoint layer so that subsequent reads stop there. Materializing copies
+// the whole text on the editing path, so buffers longer than
+// MAX_CHECKPOINT_TEXT_SIZE code units are left to read through their layers.
+uint32_t TextBuffer::MAX_LAYER_READ_DEPTH = 32;
+uint32_t TextBuffer::MAX_LAYER_CHANGE_COUNT = UINT32_MAX;
+uint32_t TextBuffer::MAX_CHECKPOINT_TEXT_SIZE = 1024 * 1024;
+
+// Checkpoints keep the layers of the buffer's history alive: their patches, and
+// the texts materialized every MAX_LAYER_READ_DEPTH layers along the way. Once
+// the layers recorded since the oldest checkpoint use more than this many
+// bytes, the oldest checkpoints are evicted.
+size_t TextBuffer::CHECKPOINT_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+static const uint32_t ROW_CACHE_SIZE = 4;
+static const uint32_t ENCODED_SIZE_BLOCK_SIZE = 64;
+static const uint32_t LONGEST_ROW_BLOCK_SIZE = 16;
+
 struct TextBuffer::Layer {
+  struct CachedRow {
+    uint32_t row;
+    uint32_t start_offset;
+    uint32_t length;
+  };
+
   Layer *previous_layer;
   Patch patch;
   optional<Text> text;
+  optional<size_t> text_digest;
   bool uses_patch;
+  bool is_checkpoint;
 
   Point extent_;
   uint32_t size_;
-  uint32_t snapshot_count;
+  std::atomic<uint32_t> snapshot_count;
+
+  CachedRow cached_rows[ROW_CACHE_SIZE];
+  uint32_t cached_row_count;
+  uint32_t next_cached_row_index;
+
+  // For a layer with its own text, the encoded size of the text preceding
+  // every ENCODED_SIZE_BLOCK_SIZE code units. Like the row cache, it is only
+  // used from the thread of the buffer that owns this layer, which its forks
+  // share. It is built the first time it's needed and must be cleared whenever
+  // this layer's text changes.
+  vector<EncodedSize> encoded_size_index;
+
+  // For a layer with its own text, the end of the longest row in every block
+  // of LONGEST_ROW_BLOCK_SIZE rows. These are the leaves of a binary tree
+  // stored in the second half of the vector, whose inner nodes hold the
+  // longer row of their two children. It is maintained like the encoded size
+  // index.
+  vector<Point> longest_row_index;
 
   Layer(Text &&text) :
     previous_layer{nullptr},
     text{move(text)},
     uses_patch{false},
+    is_checkpoint{false},
     extent_{this->text->extent()},
     size_{this->text->size()},
-    snapshot_count{0} {}
+    snapshot_count{0},
+    cached_row_count{0},
+    next_cached_row_index{0} {}
 
   Layer(Layer *previous_layer) :
     previous_layer{previous_layer},
     patch{Patch()},
     uses_patch{true},
+    is_checkpoint{false},
     extent_{previous_layer->extent()},
     size_{previous_layer->size()},
-    snapshot_count{0} {}
+    snapshot_count{0},
+    cached_row_count{0},
+    next_cached_row_index{0} {}
 
   static inline Point previous_column(Point position) {
     return Point(position.row, position.column - 1);
   }
 
+  bool has_snapshot_beneath() const {
+    const Layer *layer = previous_layer;
+    while (layer && layer->uses_patch) {
+      if (layer->snapshot_count > 0) return true;
+      layer = layer->previous_layer;
+    }
+    return false;
+  }
+
   bool is_above_layer(const Layer *layer) const {
     Layer *predecessor = previous_layer;
     while (predecessor) {
@@ -71,21 +136,24 @@ struct TextBuffer::Layer {
 
   ClipResult clip_position(Point position, bool splay = false) {
     if (!uses_patch) return text->clip_position(position);
-    if (snapshot_count > 0) splay = false;
+
+    // Snapshots can be read from any number of threads at once, so the
+    // patches of the layers they reference must never be splayed.
+    if (splay && snapshot_count > 0) splay = false;
 
     auto preceding_change = splay ?
       patch.grab_change_starting_before_new_position(position) :
       patch.get_change_starting_before_new_position(position);
     if (!preceding_change) return previous_layer->clip_position(position);
 
-    uint32_t preceding_change_base_offset =
-      previous_layer->clip_position(preceding_change->old_start).offset;
-    uint32_t preceding_change_current_offset =
-      preceding_change_base_offset +
-      preceding_change->preceding_new_text_size -
-      preceding_change->preceding_old_text_size;
-
     if (position < preceding_change->new_end) {
+      uint32_t preceding_change_base_offset =
+        previous_layer->clip_position(preceding_change->old_start).offset;
+      uint32_t preceding_change_current_offset =
+        preceding_change_base_offset +
+        preceding_change->preceding_new_text_size -
+        preceding_change->preceding_old_text_size;
+
       ClipResult position_within_preceding_change =
         preceding_change->new_text->clip_position(
           position.traversal(preceding_change->new_start)
@@ -110,12 +178,17 @@ struct TextBuffer::Layer {
         preceding_change->old_end.traverse(position.traversal(preceding_change->new_end))
       );
 
-      ClipResult distance_past_preceding_change = {
-        base_location.position.traversal(preceding_change->old_end),
-        base_location.offset - (preceding_change_base_offset + preceding_change->old_text_size)
-      };
-
-      if (distance_past_preceding_change.offset == 0 && base_location.offset < previous_layer->size()) {
+      // Past the end of the preceding change, offsets differ from the previous
+      // layer's by the total size of the changes so far. Deriving them from
+      // the base location alone means that only one position is resolved in
+      // the previous layer, rather than two at every level of the layer stack.
+      uint32_t offset_delta =
+        preceding_change->preceding_new_text_size +
+        preceding_change->new_text->size() -
+        preceding_change->preceding_old_text_size -
+        preceding_change->old_text_size;
+
+      if (base_location.position == preceding_change->old_end && base_location.offset < previous_layer->size()) {
         uint16_t previous_character = 0;
         if (preceding_change->new_text->size() > 0) {
           previous_character = preceding_change->new_text->content.back();
@@ -126,25 +199,76 @@ struct TextBuffer::Layer {
         if (previous_character == '\r' && previous_layer->character_at(base_location.position) == '\n') {
           return {
             previous_column(preceding_change->new_end),
-            preceding_change_current_offset + preceding_change->new_text->size() - 1
+            base_location.offset + offset_delta - 1
           };
         }
       }
 
       return {
-        preceding_change->new_end.traverse(distance_past_preceding_change.position),
-        preceding_change_current_offset + preceding_change->new_text->size() + distance_past_preceding_change.offset
+        preceding_change->new_end.traverse(base_location.position.traversal(preceding_change->old_end)),
+        base_location.offset + offset_delta
       };
     }
   }
 
-  template <typename Callback>
-  bool for_each_chunk_in_range(Point start, Point end, const Callback &callback, bool splay = false) {
+  // Resolving a position or an offset in a layer with a patch consults every
+  // layer beneath it. The start offset and length of a few recently used rows
+  // are remembered, so that repeated conversions on those rows, which tend to
+  // be near the cursor, don't have to walk the layers again. The cache is only
+  // used from the thread of the buffer that owns this layer, which its forks
+  // share, and must be cleared whenever this layer's text changes.
+  ClipResult clip_position_with_cache(Point position) {
+    if (!uses_patch || position.row > extent_.row) return clip_position(position, true);
+
+    const CachedRow *cached_row = nullptr;
+    for (uint32_t i = 0; i < cached_row_count; i++) {
+      if (cached_rows[i].row == position.row) {
+        cached_row = &cached_rows[i];
+        break;
+      }
+    }
+
+    if (!cached_row) {
+      CachedRow &new_row = cached_rows[next_cached_row_index];
+      new_row.row = position.row;
+      new_row.start_offset = clip_position(Point(position.row, 0), true).offset;
+      new_row.length = clip_position(Point(position.row, UINT32_MAX), true).position.column;
+      next_cached_row_index = (next_cached_row_index + 1) % ROW_CACHE_SIZE;
+      if (cached_row_count < ROW_CACHE_SIZE) cached_row_count++;
+      cached_row = &new_row;
+    }
+
+    uint32_t column = std::min(position.column, cached_row->length);
+    return {Point(position.row, column), cached_row->start_offset + column};
+  }
+
+  Point position_for_offset_with_cache(uint32_t offset) {
+    for (uint32_t i = 0; i < cached_row_count; i++) {
+      const CachedRow &cached_row = cached_rows[i];
+      if (cached_row.start_offset <= offset && offset - cached_row.start_offset <= cached_row.length) {
+        return Point(cached_row.row, offset - cached_row.start_offset);
+      }
+    }
+    return position_for_offset(offset);
+  }
+
+  void clear_cached_rows() {
+    cached_row_count = 0;
+    next_cached_row_index = 0;
+  }
+
+  // Walks the range in order, passing `callback` the chunks of text that this
+  // layer holds itself, and `gap_callback` the ranges of the previous layer's
+  // text that show through between them. Either can stop the walk by
+  // returning true.
+  template <typename Callback, typename GapCallback>
+  bool for_each_segment_in_range(Point start, Point end, const Callback &callback,
+                                 const GapCallback &gap_callback, bool splay = false) {
     Point goal_position = clip_position(end, splay).position;
     Point current_position = clip_position(start, splay).position;
 
     if (!uses_patch) return callback(TextSlice(*text).slice({current_position, goal_position}));
-    if (snapshot_count > 0) splay = false;
+    if (splay && snapshot_count > 0) splay = false;
 
     Point base_position;
     auto change = splay ?
@@ -169,9 +293,7 @@ struct TextBuffer::Layer {
       patch.get_changes_in_new_range(current_position, goal_position);
     for (const auto &change : changes) {
       if (base_position < change.old_start) {
-        if (previous_layer->for_each_chunk_in_range(base_position, change.old_start, callback)) {
-          return true;
-        }
+        if (gap_callback(base_position, change.old_start)) return true;
       }
 
       TextSlice slice = TextSlice(*change.new_text)
@@ -183,18 +305,24 @@ struct TextBuffer::Layer {
     }
 
     if (current_position < goal_position) {
-      return previous_layer->for_each_chunk_in_range(
+      return gap_callback(
         base_position,
-        base_position.traverse(goal_position.traversal(current_position)),
-        callback
+        base_position.traverse(goal_position.traversal(current_position))
       );
     }
 
     return false;
   }
 
+  template <typename Callback>
+  bool for_each_chunk_in_range(Point start, Point end, const Callback &callback, bool splay = false) {
+    return for_each_segment_in_range(start, end, callback, [this, &callback](Point start, Point end) {
+      return previous_layer->for_each_chunk_in_range(start, end, callback);
+    }, splay);
+  }
+
   Point position_for_offset(uint32_t goal_offset) const {
-    if (text) {
+    if (!uses_patch) {
       return text->position_for_offset(goal_offset);
     } else {
       return patch.new_position_for_new_offset(
@@ -209,6 +337,181 @@ struct TextBuffer::Layer {
     }
   }
 
+  void index_encoded_sizes() {
+    if (!encoded_size_index.empty()) return;
+    const uint16_t *data = text->data();
+    uint32_t size = text->size();
+    encoded_size_index.reserve(size / ENCODED_SIZE_BLOCK_SIZE + 1);
+    EncodedSize preceding_size;
+    for (uint32_t block_start = 0; block_start <= size; block_start += ENCODED_SIZE_BLOCK_SIZE) {
+      encoded_size_index.push_back(preceding_size);
+      uint32_t block_end = std::min(block_start + ENCODED_SIZE_BLOCK_SIZE, size);
+      preceding_size += EncodedSize::of(data + block_start, data + block_end);
+    }
+  }
+
+  EncodedSize encoded_size_for_position(Point position) {
+    if (!uses_patch) {
+      index_encoded_sizes();
+      uint32_t offset = text->clip_position(position).offset;
+      uint32_t block_start = offset - offset % ENCODED_SIZE_BLOCK_SIZE;
+      return encoded_size_index[offset / ENCODED_SIZE_BLOCK_SIZE] +
+        EncodedSize::of(text->data() + block_start, text->data() + offset);
+    }
+
+    return patch.new_encoded_size_for_new_position(
+      position,
+      [this](Point old_position) {
+        return previous_layer->encoded_size_for_position(old_position);
+      }
+    );
+  }
+
+  Point position_for_encoded_offset(uint32_t EncodedSize::*unit, uint32_t goal_offset) {
+    if (!uses_patch) {
+      index_encoded_sizes();
+      auto block = std::upper_bound(
+        encoded_size_index.begin() + 1,
+        encoded_size_index.end(),
+        goal_offset,
+        [unit](uint32_t offset, const EncodedSize &size) { return offset < size.*unit; }
+      ) - 1;
+      uint32_t block_start = (block - encoded_size_index.begin()) * ENCODED_SIZE_BLOCK_SIZE;
+
+      // Start scanning one code unit early, so that a block boundary between
+      // the halves of a surrogate pair can be moved back to the pair's start.
+      uint32_t scan_start = block_start > 0 ? block_start - 1 : 0;
+      const uint16_t *data = text->data();
+      EncodedSize scan_start_size = *block - EncodedSize::of(data + scan_start, data + block_start);
+      uint32_t offset = scan_start + EncodedSize::prefix_size(
+        data + scan_start,
+        data + text->size(),
+        unit,
+        goal_offset - scan_start_size.*unit
+      );
+      return text->position_for_offset(offset);
+    }
+
+    return patch.new_position_for_new_encoded_offset(
+      unit,
+      goal_offset,
+      [this](Point old_position) {
+        return previous_layer->encoded_size_for_position(old_position);
+      },
+      [this, unit](uint32_t old_offset) {
+        return previous_layer->position_for_encoded_offset(unit, old_offset);
+      }
+    );
+  }
+
+  // Compares rows by the positions of their ends, preferring the longer row
+  // and then the earlier one.
+  static Point longer_row(Point a, Point b) {
+    if (b.column > a.column || (b.column == a.column && b.row < a.row)) return b;
+    return a;
+  }
+
+  void index_longest_rows() {
+    if (!longest_row_index.empty()) return;
+    uint32_t row_count = text->extent().row + 1;
+    uint32_t block_count = (row_count + LONGEST_ROW_BLOCK_SIZE - 1) / LONGEST_ROW_BLOCK_SIZE;
+    longest_row_index.assign(2 * block_count, Point(UINT32_MAX, 0));
+    for (uint32_t row = 0; row < row_count; row++) {
+      Point &block = longest_row_index[block_count + row / LONGEST_ROW_BLOCK_SIZE];
+      block = longer_row(block, Point(row, text->line_length_for_row(row)));
+    }
+    for (uint32_t i = block_count - 1; i > 0; i--) {
+      longest_row_index[i] = longer_row(longest_row_index[2 * i], longest_row_index[2 * i + 1]);
+    }
+  }
+
+  // Returns the end of the longest row between the given rows, inclusive.
+  // Rows that a patch leaves intact are looked up in the layer beneath, so
+  // only the rows touched by changes are measured in this layer.
+  Point longest_row_in_rows(uint32_t start_row, uint32_t end_row, bool splay = false) {
+    Point result(UINT32_MAX, 0);
+
+    if (!uses_patch) {
+      index_longest_rows();
+      uint32_t block_count = longest_row_index.size() / 2;
+      uint32_t start_block = (start_row + LONGEST_ROW_BLOCK_SIZE - 1) / LONGEST_ROW_BLOCK_SIZE;
+      uint32_t end_block = (end_row + 1) / LONGEST_ROW_BLOCK_SIZE;
+      if (start_block >= end_block) {
+        start_block = end_block = start_row / LONGEST_ROW_BLOCK_SIZE;
+      }
+
+      uint32_t row = start_row;
+      for (; row < start_block * LONGEST_ROW_BLOCK_SIZE; row++) {
+        result = longer_row(result, Point(row, text->line_length_for_row(row)));
+      }
+      for (uint32_t i = start_block + block_count, j = end_block + block_count; i < j; i /= 2, j /= 2) {
+        if (i % 2) result = longer_row(result, longest_row_index[i++]);
+        if (j % 2) result = longer_row(result, longest_row_index[--j]);
+      }
+      for (row = std::max(row, end_block * LONGEST_ROW_BLOCK_SIZE); row <= end_row; row++) {
+        result = longer_row(result, Point(row, text->line_length_for_row(row)));
+      }
+      return result;
+    }
+
+    vector<Patch::Change> changes = patch.get_changes_in_new_range(
+      Point(start_row, 0),
+      Point(end_row + 1, 1)
+    );
+    auto preceding_change = patch.get_change_starting_before_new_position(Point(start_row, 0));
+    if (preceding_change &&
+        (changes.empty() || preceding_change->new_start < changes.front().new_start)) {
+      changes.insert(changes.begin(), *preceding_change);
+    }
+
+    // The rows at either end of a change are measured, along with their
+    // neighbours, because a line ending can be split between a change and the
+    // text around it. The rows in between lie wholly within the change's new
+    // text, and the patch keeps the longest of them.
+    uint32_t row = start_row;
+    Point old_end, new_end;
+    auto add_intact_rows = [&](uint32_t end) {
+      if (row >= end) return;
+      Point previous_row = previous_layer->longest_row_in_rows(
+        row - new_end.row + old_end.row,
+        end - 1 - new_end.row + old_end.row
+      );
+      previous_row.row = previous_row.row - old_end.row + new_end.row;
+      result = longer_row(result, previous_row);
+      row = end;
+    };
+
+    auto add_touched_rows = [&](uint32_t end) {
+      for (; row < end; row++) {
+        result = longer_row(result, Point(row, clip_position(Point(row, UINT32_MAX), splay).position.column));
+      }
+    };
+
+    for (const auto &change : changes) {
+      uint32_t touched_start_row = change.new_start.row > 0 ? change.new_start.row - 1 : 0;
+      add_intact_rows(std::min(touched_start_row, end_row + 1));
+      uint32_t interior_start_row = change.new_start.row + 1;
+      if (change.new_text && change.new_end.row > interior_start_row) {
+        add_touched_rows(std::min(interior_start_row, end_row + 1));
+        uint32_t interior_end_row = std::min(change.new_end.row, end_row + 1);
+        if (row == interior_start_row && interior_end_row == change.new_end.row) {
+          Point interior_row = change.new_text_longest_interior_row;
+          result = longer_row(result, Point(change.new_start.row + interior_row.row, interior_row.column));
+          row = interior_end_row;
+        }
+        for (; row < interior_end_row; row++) {
+          uint32_t length = change.new_text->line_length_for_row(row - change.new_start.row);
+          result = longer_row(result, Point(row, length));
+        }
+      }
+      add_touched_rows(std::min(change.new_end.row + 2, end_row + 1));
+      old_end = change.old_end;
+      new_end = change.new_end;
+    }
+    add_intact_rows(end_row + 1);
+    return result;
+  }
+
   Point extent() const { return extent_; }
 
   uint32_t size() const { return size_; }
@@ -222,6 +525,54 @@ struct TextBuffer::Layer {
     return result;
   }
 
+  uint32_t copy_text_in_range(Range range, uint16_t *buffer, size_t capacity, bool splay = false) {
+    size_t size = 0;
+    for_each_chunk_in_range(range.start, range.end, [&](TextSlice slice) {
+      size_t count = std::min<size_t>(slice.size(), capacity - size);
+      std::copy(slice.data(), slice.data() + count, buffer + size);
+      size += count;
+      return size == capacity;
+    }, splay);
+    return size;
+  }
+
+  // Chunks are split wherever the buffer fills up, so that the callback can
+  // consume the text in pieces of the buffer's capacity.
+  template <typename Callback>
+  void stream_text_in_range(Range range, uint16_t *buffer, size_t capacity,
+                            const Callback &callback, bool splay = false) {
+    if (capacity == 0) return;
+    size_t size = 0;
+    bool stopped = for_each_chunk_in_range(range.start, range.end, [&](TextSlice slice) {
+      const uint16_t *begin = slice.data();
+      const uint16_t *end = begin + slice.size();
+      while (begin != end) {
+        size_t count = std::min<size_t>(end - begin, capacity - size);
+        std::copy(begin, begin + count, buffer + size);
+        begin += count;
+        size += count;
+        if (size == capacity) {
+          if (callback(size)) return true;
+          size = 0;
+        }
+      }
+      return false;
+    }, splay);
+    if (!stopped && size > 0) callback(size);
+  }
+
+  // Builds this layer's full text in one pass, copying each chunk's content
+  // and line offsets into storage that is allocated up front.
+  Text compute_text() {
+    Text result;
+    result.reserve(size_, extent_.row + 1);
+    for_each_chunk_in_range(Point(), extent_, [&result](TextSlice slice) {
+      result.append(slice);
+      return false;
+    });
+    return result;
+  }
+
   vector<TextSlice> chunks_in_range(Range range) {
     vector<TextSlice> result;
     for_each_chunk_in_range(range.start, range.end, [&result](TextSlice slice) {
@@ -372,40 +723,76 @@ struct TextBuffer::Layer {
     return result;
   }
 
-  bool is_modified(const Layer *base_layer) {
+  // Only the regions of the base text that were changed need to be compared,
+  // so this takes time proportional to the size of the changes rather than to
+  // the size of the text.
+  bool is_modified(const Layer *base_layer) const {
+    if (this == base_layer) return false;
     if (size() != base_layer->size()) return true;
 
-    bool result = false;
-    uint32_t start_offset = 0;
-    for_each_chunk_in_range(Point(), extent(), [&](TextSlice chunk) {
-      if (chunk.text == &(*base_layer->text) ||
-          equal(chunk.begin(), chunk.end(), base_layer->text->begin() + start_offset)) {
-        start_offset += chunk.size();
-        return false;
-      }
-      result = true;
-      return true;
-    });
+    if (previous_layer == base_layer) {
+      return patch_modifies_text(patch, *base_layer->text);
+    }
 
-    return result;
+    vector<const Patch *> patches;
+    const Layer *layer = this;
+    while (layer != base_layer) {
+      patches.insert(patches.begin(), &layer->patch);
+      layer = layer->previous_layer;
+    }
+    return patch_modifies_text(Patch(patches), *base_layer->text);
+  }
+
+  static bool patch_modifies_text(const Patch &patch, const Text &base_text) {
+    TextSlice base{base_text};
+    for (const auto &change : patch.get_changes()) {
+      TextSlice old_text = base.slice({change.old_start, change.old_end});
+      if (old_text.size() != change.new_text->size() ||
+          !equal(old_text.begin(), old_text.end(), change.new_text->begin())) {
+        return true;
+      }
+    }
+    return false;
   }
 };
 
 TextBuffer::TextBuffer(String &&text) :
   base_layer{new Layer(move(text))},
-  top_layer{base_layer} {}
+  top_layer{base_layer},
+  origin{nullptr},
+  next_checkpoint_id{1},
+  checkpoint_memory_usage{0} {}
 
 TextBuffer::TextBuffer() :
   base_layer{new Layer(Text{})},
-  top_layer{base_layer} {}
+  top_layer{base_layer},
+  origin{nullptr},
+  next_checkpoint_id{1},
+  checkpoint_memory_usage{0} {}
+
+TextBuffer::TextBuffer(Snapshot *origin) :
+  base_layer{&origin->base_layer},
+  top_layer{new Layer(&origin->layer)},
+  origin{origin},
+  next_checkpoint_id{1},
+  checkpoint_memory_usage{0} {}
 
 TextBuffer::~TextBuffer() {
+  for (auto &checkpoint : checkpoints) delete checkpoint.snapshot;
+  checkpoints.clear();
+
   Layer *layer = top_layer;
-  while (layer) {
+  Layer *end = shared_layer();
+  while (layer && layer != end) {
     Layer *previous_layer = layer->previous_layer;
     delete layer;
     layer = previous_layer;
   }
+  delete origin;
+}
+
+TextBuffer::Layer *TextBuffer::shared_layer() const {
+  return origin ? &origin->layer : nullptr;
 }
 
 TextBuffer::TextBuffer(const std::u16string &text) :
@@ -413,8 +800,9 @@ TextBuffer::TextBuffer(const std::u16string &text) :
 
 void TextBuffer::reset(Text &&new_base_text) {
   bool has_snapshot = false;
+  Layer *end = shared_layer();
   auto layer = top_layer;
-  while (layer) {
+  while (layer && layer != end) {
     if (layer->snapshot_count > 0) {
       has_snapshot = true;
       break;
@@ -429,15 +817,21 @@ void TextBuffer::reset(Text &&new_base_text) {
   }
 
   layer = top_layer->previous_layer;
-  while (layer) {
+  while (layer && layer != end) {
     Layer *previous_layer = layer->previous_layer;
     delete layer;
     layer = previous_layer;
   }
+  delete origin;
+  origin = nullptr;
 
   top_layer->extent_ = new_base_text.extent();
   top_layer->size_ = new_base_text.size();
   top_layer->text = move(new_base_text);
+  top_layer->text_digest = optional<size_t>{};
+  top_layer->encoded_size_index.clear();
+  top_layer->longest_row_index.clear();
+  top_layer->clear_cached_rows();
   top_layer->patch.clear();
   top_layer->uses_patch = false;
   base_layer = top_layer;
@@ -455,18 +849,58 @@ Patch TextBuffer::get_inverted_changes(const Snapshot *snapshot) const {
   TextSlice base{*snapshot->base_layer.text};
   Patch result;
   for (auto change : combination.get_changes()) {
+    uint32_t new_text_size = change.new_text->size();
     result.splice(
       change.old_start,
       change.new_end.traversal(change.new_start),
       change.old_end.traversal(change.old_start),
-      *change.new_text,
+      move(*change.new_text),
       Text{base.slice({change.old_start, change.old_end})},
-      change.new_text->size()
+      new_text_size
     );
   }
   return result;
 }
 
+Patch TextBuffer::changes_between(const Snapshot *from, const Snapshot *to) const {
+  Layer *older_layer = &from->layer;
+  Layer *newer_layer = &to->layer;
+  bool inverted = older_layer->is_above_layer(newer_layer);
+  if (inverted) std::swap(older_layer, newer_layer);
+
+  vector<const Patch *> patches;
+  for (Layer *layer = newer_layer; layer != older_layer; layer = layer->previous_layer) {
+    patches.insert(patches.begin(), &layer->patch);
+  }
+  Patch combination(patches);
+  Patch result;
+  for (auto change : combination.get_changes()) {
+    Text old_text{older_layer->text_in_range({change.old_start, change.old_end})};
+    if (inverted) {
+      uint32_t new_text_size = change.new_text->size();
+      result.splice(
+        change.old_start,
+        change.new_end.traversal(change.new_start),
+        change.old_end.traversal(change.old_start),
+        move(*change.new_text),
+        move(old_text),
+        new_text_size
+      );
+    } else {
+      uint32_t old_text_size = old_text.size();
+      result.splice(
+        change.new_start,
+        change.old_end.traversal(change.old_start),
+        change.new_end.traversal(change.new_start),
+        move(old_text),
+        move(*change.new_text),
+        old_text_size
+      );
+    }
+  }
+  return result;
+}
+
 void TextBuffer::serialize_changes(Serializer &serializer) {
   serializer.append(top_layer->size_);
   top_layer->extent_.serialize(serializer);
@@ -494,14 +928,42 @@ bool TextBuffer::deserialize_changes(Deserializer &deserializer) {
   top_layer = new Layer(base_layer);
   top_layer->size_ = deserializer.read<uint32_t>();
   top_layer->extent_ = Point(deserializer);
-  top_layer->patch = Patch(deserializer);
+
+  // The encoded sizes of the replaced text aren't serialized, so the changes
+  // are spliced again, measuring that text in the base layer.
+  Patch patch(deserializer);
+  for (const auto &change : patch.get_changes()) {
+    EncodedSize old_text_encoded_size;
+    base_layer->for_each_chunk_in_range(change.old_start, change.old_end, [&old_text_encoded_size](TextSlice chunk) {
+      old_text_encoded_size += EncodedSize::of(chunk.data(), chunk.data() + chunk.size());
+      return false;
+    });
+    top_layer->patch.splice(
+      change.new_start,
+      change.old_end.traversal(change.old_start),
+      change.new_end.traversal(change.new_start),
+      optional<Text>{},
+      change.new_text ? optional<Text>{*change.new_text} : optional<Text>{},
+      change.old_text_size,
+      old_text_encoded_size
+    );
+  }
   return true;
 }
 
+uint32_t TextBuffer::longest_row() {
+  return top_layer->longest_row_in_rows(0, top_layer->extent().row, true).row;
+}
+
 const Text &TextBuffer::base_text() const {
   return *base_layer->text;
 }
 
+size_t TextBuffer::base_text_digest() const {
+  if (!base_layer->text_digest) base_layer->text_digest = base_layer->text->digest();
+  return *base_layer->text_digest;
+}
+
 Point TextBuffer::extent() const {
   return top_layer->extent();
 }
@@ -512,7 +974,7 @@ uint32_t TextBuffer::size() const {
 
 optional<uint32_t> TextBuffer::line_length_for_row(uint32_t row) {
   if (row > extent().row) return optional<uint32_t>{};
-  return top_layer->clip_position(Point{row, UINT32_MAX}, true).position.column;
+  return top_layer->clip_position_with_cache(Point{row, UINT32_MAX}).position.column;
 }
 
 const uint16_t *TextBuffer::line_ending_for_row(uint32_t row) {
@@ -565,11 +1027,29 @@ optional<String> TextBuffer::line_for_row(uint32_t row) {
 }
 
 ClipResult TextBuffer::clip_position(Point position) {
-  return top_layer->clip_position(position, true);
+  return top_layer->clip_position_with_cache(position);
 }
 
 Point TextBuffer::position_for_offset(uint32_t offset) {
-  return top_layer->position_for_offset(offset);
+  return top_layer->position_for_offset_with_cache(offset);
+}
+
+uint32_t TextBuffer::utf8_offset_for_position(Point position) {
+  Point clipped_position = top_layer->clip_position_with_cache(position).position;
+  return top_layer->encoded_size_for_position(clipped_position).utf8_size;
+}
+
+Point TextBuffer::position_for_utf8_offset(uint32_t offset) {
+  return top_layer->position_for_encoded_offset(&EncodedSize::utf8_size, offset);
+}
+
+uint32_t TextBuffer::code_point_offset_for_position(Point position) {
+  Point clipped_position = top_layer->clip_position_with_cache(position).position;
+  return top_layer->encoded_size_for_position(clipped_position).code_point_count;
+}
+
+Point TextBuffer::position_for_code_point_offset(uint32_t offset) {
+  return top_layer->position_for_encoded_offset(&EncodedSize::code_point_count, offset);
 }
 
 String TextBuffer::text() {
@@ -580,10 +1060,195 @@ String TextBuffer::text_in_range(Range range) {
   return top_layer->text_in_range(range, true);
 }
 
+uint32_t TextBuffer::copy_text_in_range(Range range, uint16_t *buffer, size_t capacity) {
+  return top_layer->copy_text_in_range(range, buffer, capacity, true);
+}
+
+void TextBuffer::copy_text_in_range(Range range, uint16_t *buffer, size_t capacity,
+                                    const std::function<bool(uint32_t)> &callback) {
+  top_layer->stream_text_in_range(range, buffer, capacity, callback, true);
+}
+
 vector<TextSlice> TextBuffer::chunks() const {
   return top_layer->chunks_in_range({{0, 0}, extent()});
 }
 
+TextBuffer::ChunkIterator TextBuffer::chunk_iterator(Range range) const {
+  return ChunkIterator(top_layer, range);
+}
+
+TextBuffer::LineIterator TextBuffer::line_iterator(uint32_t start_row, uint32_t end_row) const {
+  return LineIterator(top_layer, start_row, end_row);
+}
+
+String TextBuffer::lines_in_rows(uint32_t start_row, uint32_t end_row,
+                                 vector<uint32_t> *line_start_offsets) const {
+  String result;
+  end_row = std::min(end_row, top_layer->extent().row + 1);
+  if (start_row < end_row) {
+    result.reserve(
+      top_layer->clip_position(Point(end_row, 0)).offset -
+      top_layer->clip_position(Point(start_row, 0)).offset
+    );
+    line_start_offsets->reserve(line_start_offsets->size() + end_row - start_row + 1);
+  }
+
+  if (start_row < end_row) {
+    uint32_t row = start_row;
+    size_t line_start_offset = result.size();
+    line_start_offsets->push_back(line_start_offset);
+    top_layer->for_each_chunk_in_range(Point(start_row, 0), Point(end_row, 0), [&](TextSlice chunk) {
+      const uint16_t *begin = chunk.data(), *end = begin + chunk.size();
+      for (;;) {
+        const uint16_t *newline = std::find(begin, end, '\n');
+        result.insert(result.end(), begin, newline);
+        if (newline == end) return false;
+        if (result.size() > line_start_offset && result.back() == '\r') result.pop_back();
+        if (++row < end_row) {
+          line_start_offset = result.size();
+          line_start_offsets->push_back(line_start_offset);
+        }
+        begin = newline + 1;
+      }
+    });
+  }
+  line_start_offsets->push_back(result.size());
+  return result;
+}
+
+TextBuffer::ChunkIterator::ChunkIterator() : layer{nullptr} {}
+
+TextBuffer::ChunkIterator::ChunkIterator(Layer *layer, Range range) :
+  layer{layer},
+  position{layer->clip_position(range.start).position},
+  pending_segments{{layer, range, TextSlice()}} {
+  load_chunk();
+}
+
+// Segments that are still to be visited are kept on a stack, with the next
+// one on top. A range of a layer is replaced by the layer's own chunks and the
+// ranges of the previous layer between them, so every change in every layer
+// is visited once over a whole iteration.
+void TextBuffer::ChunkIterator::load_chunk() {
+  while (!pending_segments.empty()) {
+    Segment segment = pending_segments.back();
+    pending_segments.pop_back();
+    if (!segment.layer) {
+      if (segment.chunk.empty()) continue;
+      chunk = segment.chunk;
+      return;
+    }
+
+    size_t first_index = pending_segments.size();
+    segment.layer->for_each_segment_in_range(
+      segment.range.start,
+      segment.range.end,
+      [this](TextSlice chunk) {
+        pending_segments.push_back({nullptr, Range(), chunk});
+        return false;
+      },
+      [this, &segment](Point start, Point end) {
+        pending_segments.push_back({segment.layer->previous_layer, Range{start, end}, TextSlice()});
+        return false;
+      }
+    );
+    std::reverse(pending_segments.begin() + first_index, pending_segments.end());
+  }
+
+  layer = nullptr;
+}
+
+TextBuffer::ChunkIterator &TextBuffer::ChunkIterator::operator++() {
+  position = position.traverse(chunk.extent());
+  load_chunk();
+  return *this;
+}
+
+bool TextBuffer::ChunkIterator::operator==(const ChunkIterator &other) const {
+  if (!layer || !other.layer) return layer == other.layer;
+  return layer == other.layer && position == other.position;
+}
+
+TextBuffer::LineIterator::LineIterator() :
+  remaining_begin{nullptr},
+  remaining_end{nullptr},
+  end_row{0},
+  line{0, nullptr, 0} {}
+
+TextBuffer::LineIterator::LineIterator(Layer *layer, uint32_t start_row, uint32_t end_row) :
+  chunks{layer, Range{Point(start_row, 0), Point(end_row, 0)}},
+  remaining_begin{nullptr},
+  remaining_end{nullptr},
+  end_row{std::min(end_row, layer->extent().row + 1)},
+  line{start_row, nullptr, 0} {
+  load_line();
+}
+
+void TextBuffer::LineIterator::load_line() {
+  if (line.row >= end_row) {
+    end_row = 0;
+    line = {0, nullptr, 0};
+    return;
+  }
+
+  bool copied = false;
+  buffer.clear();
+
+  for (;;) {
+    if (remaining_begin == remaining_end) {
+      if (chunks == ChunkIterator()) break;
+      remaining_begin = chunks->data();
+      remaining_end = remaining_begin + chunks->size();
+      ++chunks;
+    }
+
+    const uint16_t *newline = std::find(remaining_begin, remaining_end, '\n');
+    if (newline == remaining_end) {
+      if (!copied && chunks == ChunkIterator()) {
+        line.data = remaining_begin;
+        line.size = remaining_end - remaining_begin;
+        remaining_begin = remaining_end;
+        return;
+      }
+      buffer.insert(buffer.end(), remaining_begin, remaining_end);
+      remaining_begin = remaining_end;
+      copied = true;
+      continue;
+    }
+
+    if (copied) {
+      buffer.insert(buffer.end(), remaining_begin, newline);
+    } else {
+      line.data = remaining_begin;
+      line.size = newline - remaining_begin;
+    }
+    remaining_begin = newline + 1;
+
+    if (copied) {
+      if (!buffer.empty() && buffer.back() == '\r') buffer.pop_back();
+      line.data = buffer.data();
+      line.size = buffer.size();
+    } else if (line.size > 0 && line.data[line.size - 1] == '\r') {
+      line.size--;
+    }
+    return;
+  }
+
+  line.data = buffer.data();
+  line.size = buffer.size();
+}
+
+TextBuffer::LineIterator &TextBuffer::LineIterator::operator++() {
+  line.row++;
+  load_line();
+  return *this;
+}
+
+bool TextBuffer::LineIterator::operator==(const LineIterator &other) const {
+  if (end_row == 0 || other.end_row == 0) return end_row == other.end_row;
+  return line.row == other.line.row;
+}
+
 void TextBuffer::set_text(String &&new_text) {
   set_text_in_range(Range{Point(0, 0), extent()}, move(new_text));
 }
@@ -592,18 +1257,100 @@ void TextBuffer::set_text(const u16string &string) {
   set_text(String(string.begin(), string.end()));
 }
 
+void TextBuffer::push_layer() {
+  if (top_layer != base_layer && top_layer->size() <= MAX_CHECKPOINT_TEXT_SIZE) {
+    LayerStatistics statistics = layer_statistics();
+    if (statistics.read_depth >= MAX_LAYER_READ_DEPTH ||
+        statistics.change_count > MAX_LAYER_CHANGE_COUNT) {
+      // Until now, reads stopped at the previous checkpoint layer, if any. Its
+      // text is kept until the newest checkpoint is evicted, along with every
+      // checkpoint beneath it, so charge the text to the newest checkpoint.
+      Layer *previous_checkpoint = top_layer;
+      while (previous_checkpoint->uses_patch && previous_checkpoint != shared_layer()) {
+        previous_checkpoint = previous_checkpoint->previous_layer;
+      }
+      if (previous_checkpoint->is_checkpoint && !checkpoints.empty()) {
+        size_t text_memory_usage = previous_checkpoint->text->memory_usage();
+        checkpoints.back().memory_usage += text_memory_usage;
+        checkpoint_memory_usage += text_memory_usage;
+      }
+
+      Layer *checkpoint = new Layer(top_layer);
+      checkpoint->text = checkpoint->compute_text();
+      checkpoint->uses_patch = false;
+      checkpoint->is_checkpoint = true;
+      top_layer = checkpoint;
+    }
+  }
+
+  top_layer = new Layer(top_layer);
+}
+
 void TextBuffer::set_text_in_range(Range old_range, String &&string) {
-  if (top_layer == base_layer || top_layer->snapshot_count > 0) {
-    top_layer = new Layer(top_layer);
+  if (top_layer == base_layer || top_layer->snapshot_count > 0) push_layer();
+
+  splice_top_layer(old_range, move(string));
+}
+
+void TextBuffer::set_text_in_range(Range old_range, const u16string &string) {
+  set_text_in_range(old_range, String(string.begin(), string.end()));
+}
+
+void TextBuffer::set_text_in_ranges(vector<pair<Range, String>> &&changes) {
+  if (changes.empty()) return;
+
+  if (top_layer == base_layer || top_layer->snapshot_count > 0) push_layer();
+
+  std::stable_sort(changes.begin(), changes.end(), [](const pair<Range, String> &a,
+                                                      const pair<Range, String> &b) {
+    return a.first.start < b.first.start ||
+      (a.first.start == b.first.start && a.first.end < b.first.end);
+  });
+
+  // Apply the changes from last to first. Each splice then lands before all
+  // of the changes applied so far, so the remaining ranges stay valid and
+  // the patch only needs to splay its leftmost node.
+  Point next_start(UINT32_MAX, UINT32_MAX);
+  for (auto iter = changes.rbegin(), end = changes.rend(); iter != end; ++iter) {
+    Range range = iter->first;
+    if (range.end > next_start) range.end = next_start;
+    if (range.start > range.end) range.start = range.end;
+    splice_top_layer(range, move(iter->second));
+    next_start = range.start;
   }
+}
 
-  auto start = clip_position(old_range.start);
-  auto end = clip_position(old_range.end);
+// Positions are normally clipped to the start of a CRLF line ending. When
+// `splits_line_endings` is true, a position between the carriage return and
+// the newline is kept instead, so that changes computed from another version
+// of the text, which may join or split such a line ending, apply exactly.
+void TextBuffer::splice_top_layer(Range old_range, String &&string, bool splits_line_endings) {
+  EncodedSize start_encoded_size_adjustment, end_encoded_size_adjustment;
+  auto clip = [&](Point position, EncodedSize &encoded_size_adjustment) {
+    ClipResult result = top_layer->clip_position(position, true);
+    if (splits_line_endings && position.row == result.position.row &&
+        position.column == result.position.column + 1 &&
+        top_layer->character_at(result.position) == '\r') {
+      encoded_size_adjustment = EncodedSize(1, 1);
+      return ClipResult{position, result.offset + 1};
+    }
+    return result;
+  };
+
+  auto start = clip(old_range.start, start_encoded_size_adjustment);
+  auto end = clip(old_range.end, end_encoded_size_adjustment);
+  top_layer->clear_cached_rows();
   Point deleted_extent = end.position.traversal(start.position);
   Text new_text{move(string)};
   Point inserted_extent = new_text.extent();
   Point new_range_end = start.position.traverse(new_text.extent());
   uint32_t deleted_text_size = end.offset - start.offset;
+  EncodedSize deleted_text_encoded_size;
+  if (deleted_text_size > 0) {
+    deleted_text_encoded_size =
+      top_layer->encoded_size_for_position(end.position) + end_encoded_size_adjustment -
+      top_layer->encoded_size_for_position(start.position) - start_encoded_size_adjustment;
+  }
   top_layer->extent_ = new_range_end.traverse(top_layer->extent_.traversal(end.position));
   top_layer->size_ += new_text.size() - deleted_text_size;
   top_layer->patch.splice(
@@ -612,7 +1359,8 @@ void TextBuffer::set_text_in_range(Range old_range, String &&string) {
     inserted_extent,
     optional<Text>{},
     move(new_text),
-    deleted_text_size
+    deleted_text_size,
+    deleted_text_encoded_size
   );
 
   auto change = top_layer->patch.grab_change_starting_before_new_position(start.position);
@@ -637,10 +1385,6 @@ void TextBuffer::set_text_in_range(Range old_range, String &&string) {
   }
 }
 
-void TextBuffer::set_text_in_range(Range old_range, const u16string &string) {
-  set_text_in_range(old_range, String(string.begin(), string.end()));
-}
-
 optional<Range> TextBuffer::find(const Regex &regex) const {
   return top_layer->search_in_range(regex, Range{Point(), extent()}, false);
 }
@@ -671,8 +1415,9 @@ string TextBuffer::get_dot_graph() const {
        iter != end; ++iter) {
     auto layer = *iter;
     auto index = iter - begin;
-    result << "graph { label=\"layer " << index << " (snapshot count " << layer->snapshot_count;
+    result << "graph { label=\"layer " << index << " (snapshot count " << layer->snapshot_count.load();
     if (layer == base_layer) result << ", base";
+    if (layer->is_checkpoint) result << ", checkpoint";
     if (layer->uses_patch) result << ", uses_patch";
     result << "):\" }\n";
     if (layer->text) result << "graph { label=\"text:\n" << *layer->text << "\" }\n";
@@ -691,15 +1436,121 @@ size_t TextBuffer::layer_count() const {
   return result;
 }
 
+TextBuffer::LayerStatistics TextBuffer::layer_statistics() const {
+  LayerStatistics result{layer_count(), 0, 0};
+  const Layer *layer = top_layer;
+  while (layer->uses_patch) {
+    result.read_depth++;
+    result.change_count += layer->patch.get_change_count();
+    layer = layer->previous_layer;
+  }
+  return result;
+}
+
+// Reports the memory used by each layer, starting with the bottom-most one.
+vector<TextBuffer::LayerMemoryUsage> TextBuffer::memory_usage() const {
+  vector<LayerMemoryUsage> result;
+  for (const Layer *layer = top_layer; layer; layer = layer->previous_layer) {
+    result.push_back({
+      layer == base_layer,
+      layer->snapshot_count,
+      (layer->text ? layer->text->memory_usage() : 0) +
+        layer->encoded_size_index.capacity() * sizeof(EncodedSize) +
+        layer->longest_row_index.capacity() * sizeof(Point),
+      layer->patch.memory_usage()
+    });
+  }
+  std::reverse(result.begin(), result.end());
+  return result;
+}
+
 TextBuffer::Snapshot *TextBuffer::create_snapshot() {
   top_layer->snapshot_count++;
   base_layer->snapshot_count++;
   return new Snapshot(*this, *top_layer, *base_layer);
 }
 
+TextBuffer *TextBuffer::fork() {
+  return new TextBuffer(create_snapshot());
+}
+
+uint32_t TextBuffer::create_checkpoint() {
+  Layer *previous_checkpoint_layer =
+    checkpoints.empty() ? nullptr : &checkpoints.back().snapshot->layer;
+  size_t memory_usage = 0;
+  for (Layer *layer = top_layer;
+       layer != previous_checkpoint_layer && layer != base_layer && layer != shared_layer();
+       layer = layer->previous_layer) {
+    auto patch_memory_usage = layer->patch.memory_usage();
+    memory_usage += patch_memory_usage.node_bytes +
+      patch_memory_usage.old_text_bytes + patch_memory_usage.new_text_bytes;
+  }
+
+  uint32_t id = next_checkpoint_id++;
+  checkpoints.push_back({id, create_snapshot(), memory_usage});
+  checkpoint_memory_usage += memory_usage;
+
+  auto first_retained_checkpoint = checkpoints.begin();
+  size_t retained_memory_usage = checkpoint_memory_usage;
+  while (first_retained_checkpoint + 1 != checkpoints.end() &&
+         retained_memory_usage > CHECKPOINT_MEMORY_BUDGET) {
+    retained_memory_usage -= first_retained_checkpoint->memory_usage;
+    ++first_retained_checkpoint;
+  }
+  delete_checkpoints(checkpoints.begin(), first_retained_checkpoint);
+  return id;
+}
+
+bool TextBuffer::revert_to_checkpoint(uint32_t id) {
+  auto checkpoint = find_checkpoint(id);
+  if (checkpoint == checkpoints.end()) return false;
+  Snapshot *snapshot = checkpoint->snapshot;
+  group_changes_since(id);
+
+  Snapshot *current_snapshot = create_snapshot();
+  Patch changes = changes_between(current_snapshot, snapshot);
+  delete current_snapshot;
+
+  // The changes are applied from last to first, like in set_text_in_ranges,
+  // but without clipping, since an edit after the checkpoint may have joined
+  // a carriage return and a newline.
+  auto change_list = changes.get_changes();
+  if (change_list.empty()) return true;
+  if (top_layer == base_layer || top_layer->snapshot_count > 0) push_layer();
+  for (auto iter = change_list.rbegin(), end = change_list.rend(); iter != end; ++iter) {
+    splice_top_layer({iter->old_start, iter->old_end}, move(iter->new_text->content), true);
+  }
+  return true;
+}
+
+bool TextBuffer::group_changes_since(uint32_t id) {
+  auto checkpoint = find_checkpoint(id);
+  if (checkpoint == checkpoints.end()) return false;
+  delete_checkpoints(checkpoint + 1, checkpoints.end());
+  return true;
+}
+
+vector<TextBuffer::Checkpoint>::iterator TextBuffer::find_checkpoint(uint32_t id) {
+  auto checkpoint = std::lower_bound(checkpoints.begin(), checkpoints.end(), id,
+                                     [](const Checkpoint &checkpoint, uint32_t id) {
+    return checkpoint.id < id;
+  });
+  if (checkpoint != checkpoints.end() && checkpoint->id != id) return checkpoints.end();
+  return checkpoint;
+}
+
+void TextBuffer::delete_checkpoints(vector<Checkpoint>::iterator begin,
+                                    vector<Checkpoint>::iterator end) {
+  for (auto iter = begin; iter != end; ++iter) {
+    checkpoint_memory_usage -= iter->memory_usage;
+    delete iter->snapshot;
+  }
+  checkpoints.erase(begin, end);
+}
+
 void TextBuffer::flush_changes() {
   if (!top_layer->text) {
-    top_layer->text = Text{text()};
+    top_layer->text = top_layer->compute_text();
     base_layer = top_layer;
     consolidate_layers();
   }
@@ -725,6 +1576,15 @@ String TextBuffer::Snapshot::text() const {
   return layer.text_in_range({{0, 0}, extent()});
 }
 
+uint32_t TextBuffer::Snapshot::copy_text_in_range(Range range, uint16_t *buffer, size_t capacity) const {
+  return layer.copy_text_in_range(range, buffer, capacity);
+}
+
+void TextBuffer::Snapshot::copy_text_in_range(Range range, uint16_t *buffer, size_t capacity,
+                                              const std::function<bool(uint32_t)> &callback) const {
+  layer.stream_text_in_range(range, buffer, capacity, callback);
+}
+
 vector<TextSlice> TextBuffer::Snapshot::chunks_in_range(Range range) const {
   return layer.chunks_in_range(range);
 }
@@ -741,52 +1601,114 @@ const Text &TextBuffer::Snapshot::base_text() const {
   return *base_layer.text;
 }
 
+TextBuffer::ChunkIterator TextBuffer::Snapshot::chunk_iterator(Range range) const {
+  return ChunkIterator(&layer, range);
+}
+
+TextBuffer::LineIterator TextBuffer::Snapshot::line_iterator(uint32_t start_row, uint32_t end_row) const {
+  return LineIterator(&layer, start_row, end_row);
+}
+
 TextBuffer::Snapshot::Snapshot(TextBuffer &buffer, TextBuffer::Layer &layer,
                                TextBuffer::Layer &base_layer)
   : buffer{buffer}, layer{layer}, base_layer{base_layer} {}
 
 void TextBuffer::Snapshot::flush_preceding_changes() {
+  if (!layer.text) flush_preceding_changes(layer.compute_text());
+}
+
+// Stores text that was built by `compute_preceding_text`, possibly on another
+// thread, as this snapshot's base text. This must be called on the thread that
+// owns the buffer.
+void TextBuffer::Snapshot::flush_preceding_changes(Text &&text) {
   if (!layer.text) {
-    layer.text = Text{text()};
+    assert(text.size() == layer.size());
+    layer.text = move(text);
     if (layer.is_above_layer(buffer.base_layer)) buffer.base_layer = &layer;
     buffer.consolidate_layers();
   }
 }
 
+// Builds the text that `flush_preceding_changes` would store, without
+// modifying the buffer. The layers beneath a snapshot are not mutated while
+// it exists, so this can run on a different thread than the one editing the
+// buffer.
+Text TextBuffer::Snapshot::compute_preceding_text() const {
+  return layer.compute_text();
+}
+
 TextBuffer::Snapshot::~Snapshot() {
   assert(layer.snapshot_count > 0);
-  layer.snapshot_count--;
-  base_layer.snapshot_count--;
-  if (layer.snapshot_count == 0 || base_layer.snapshot_count == 0) {
+  bool released_layer = --layer.snapshot_count == 0;
+  bool released_base_layer = --base_layer.snapshot_count == 0;
+  if (released_layer || released_base_layer) {
     buffer.consolidate_layers();
   }
 }
 
 void TextBuffer::consolidate_layers() {
   Layer *layer = top_layer;
+  Layer *layer_above = nullptr;
+  Layer *layer_above_mutable_layers = nullptr;
   vector<Layer *> mutable_layers;
   bool needed_by_layer_above = false;
+  bool above_base_layer = true;
+  Layer *end = shared_layer();
+
+  while (layer && layer != end) {
+    if (layer == base_layer) above_base_layer = false;
 
-  while (layer) {
     if (needed_by_layer_above || layer->snapshot_count > 0) {
       squash_layers(mutable_layers);
       mutable_layers.clear();
       needed_by_layer_above = true;
     } else {
-      if (layer == base_layer) {
+      // A checkpoint only pays for its text while snapshots pin the layers
+      // beneath it. Otherwise, those layers can be squashed, so turn the
+      // checkpoint back into an ordinary patch layer.
+      bool keep_checkpoint = false;
+      if (layer->is_checkpoint) {
+        if (above_base_layer && layer->has_snapshot_beneath()) {
+          keep_checkpoint = true;
+        } else {
+          layer->text = optional<Text>();
+          layer->encoded_size_index.clear();
+          layer->longest_row_index.clear();
+          layer->uses_patch = true;
+          layer->is_checkpoint = false;
+        }
+      }
+
+      if (layer == base_layer || keep_checkpoint) {
         squash_layers(mutable_layers);
         mutable_layers.clear();
       }
 
       if (layer->text) layer->uses_patch = false;
+      if (mutable_layers.empty()) layer_above_mutable_layers = layer_above;
       mutable_layers.push_back(layer);
     }
 
     if (!layer->uses_patch) needed_by_layer_above = false;
+    layer_above = layer;
     layer = layer->previous_layer;
   }
 
-  squash_layers(mutable_layers);
+  // If the bottom-most layers don't start with a layer that has its own text,
+  // they sit beneath a layer that does, so nothing can read through them. Free
+  // them rather than materializing their text. A checkpoint above them could
+  // otherwise go back to reading through them, so it keeps its text for good.
+  // In a fork, the bottom-most layers read through the layers it shares, so
+  // they are squashed onto those instead.
+  if (!mutable_layers.empty() && !mutable_layers.front()->text && !end &&
+      layer_above_mutable_layers) {
+    assert(!layer_above_mutable_layers->uses_patch);
+    layer_above_mutable_layers->previous_layer = nullptr;
+    layer_above_mutable_layers->is_checkpoint = false;
+    for (Layer *layer : mutable_layers) delete layer;
+  } else {
+    squash_layers(mutable_layers);
+  }
 }
 
 void TextBuffer::squash_layers(const vector<Layer *> &layers) {
@@ -794,29 +1716,6 @@ void TextBuffer::squash_layers(const vector<Layer *> &layers) {
   size_t layer_count = layers.size();
   if (layer_count < 2) return;
 
-  // Find the highest layer that has already computed its text.
-  optional<Text> text;
-  for (layer_index = 0; layer_index < layer_count; layer_index++) {
-    if (layers[layer_index]->text) {
-      text = move(*layers[layer_index]->text);
-      break;
-    }
-  }
-
-  // Incorporate into that text the patches from all the layers above.
-  if (text) {
-    layer_index--;
-    for (; layer_index + 1 > 0; layer_index--) {
-      for (auto change : layers[layer_index]->patch.get_changes()) {
-        text->splice(
-          change.new_start,
-          change.old_end.traversal(change.old_start),
-          *change.new_text
-        );
-      }
-    }
-  }
-
   // If there is another layer below these layers, combine their patches into
   // into one. Otherwise, this is the new base layer, so we don't need a patch.
   Patch patch;
@@ -829,15 +1728,17 @@ void TextBuffer::squash_layers(const vector<Layer *> &layers) {
 
     bool left_to_right = true;
     for (; layer_index + 1 > 0; layer_index--) {
-      patch.combine(layers[layer_index]->patch, left_to_right);
+      patch.combine(move(layers[layer_index]->patch), left_to_right);
       left_to_right = !left_to_right;
     }
   } else {
-    assert(text);
+    assert(layers[0]->text);
   }
 
+  // Any text computed by the lower layers is discarded. If the top layer
+  // doesn't have its own text, it reads through the combined patch instead of
+  // splicing every change into a copy of the lower layer's text.
   layers[0]->previous_layer = previous_layer;
-  layers[0]->text = move(text);
   layers[0]->patch = move(patch);
 
   for (layer_index = 1; layer_index < layer_count; layer_index++) {
@@ -1,9 +1,11 @@
 #ifndef SUPERSTRING_TEXT_BUFFER_H_
 #define SUPERSTRING_TEXT_BUFFER_H_
 
+#include <iterator>
 #include <string>
 #include <vector>
 #include "text.h"
+#include "text-slice.h"
 #include "patch.h"
 #include "point.h"
 #include "range.h"
@@ -15,9 +17,15 @@ class TextBuffer {
   Layer *top_layer;
   void squash_layers(const std::vector<Layer *> &);
   void consolidate_layers();
+  void push_layer();
+  void splice_top_layer(Range, Text::String &&, bool splits_line_endings = false);
 
 public:
   static uint32_t MAX_CHUNK_SIZE_TO_COPY;
+  static uint32_t MAX_LAYER_READ_DEPTH;
+  static uint32_t MAX_LAYER_CHANGE_COUNT;
+  static uint32_t MAX_CHECKPOINT_TEXT_SIZE;
+  static size_t CHECKPOINT_MEMORY_BUDGET;
 
   TextBuffer();
   TextBuffer(Text::String &&text);
@@ -31,14 +39,51 @@ public:
 
   optional<uint32_t> line_length_for_row(uint32_t row);
   const uint16_t *line_ending_for_row(uint32_t row);
+
+  // The row whose line is the longest, excluding its line ending, or the
+  // first such row if there are several. Only the rows touched by unflushed
+  // changes are measured; the other rows are looked up in a summary of the
+  // longest row in each block of rows, built once per layer with its own text.
+  uint32_t longest_row();
   ClipResult clip_position(Point);
   Point position_for_offset(uint32_t offset);
+
+  // Positions and offsets count UTF-16 code units. These convert them to and
+  // from offsets in UTF-8 bytes or in code points, without copying any text.
+  // Offsets that fall within a character resolve to the character's start.
+  uint32_t utf8_offset_for_position(Point);
+  Point position_for_utf8_offset(uint32_t);
+  uint32_t code_point_offset_for_position(Point);
+  Point position_for_code_point_offset(uint32_t);
+
   Text::String text();
   Text::String text_in_range(Range range);
+
+  // Copies the text in a range into a buffer owned by the caller, without
+  // allocating. Returns the number of code units copied, which is less than
+  // the size of the range if the buffer is too small to hold all of it.
+  uint32_t copy_text_in_range(Range, uint16_t *buffer, size_t capacity);
+
+  // Streams the text in a range through a buffer owned by the caller. Each
+  // time the buffer is full, and once more for any remainder, the callback is
+  // passed the number of code units in the buffer. Returning true from the
+  // callback stops the copy.
+  void copy_text_in_range(Range, uint16_t *buffer, size_t capacity,
+                          const std::function<bool(uint32_t)> &callback);
+
   void set_text(Text::String &&);
   void set_text(const std::u16string &);
   void set_text_in_range(Range old_range, Text::String &&);
   void set_text_in_range(Range old_range, const std::u16string &);
+
+  // Replaces several ranges at once. The ranges may be given in any order, and
+  // all refer to the text as it was before any of them are replaced. They are
+  // sorted by start, then by end. Where two ranges overlap, the earlier one is
+  // truncated at the start of the later one, and both texts are inserted, the
+  // earlier one first. A range whose end precedes its start is collapsed to
+  // its end.
+  void set_text_in_ranges(std::vector<std::pair<Range, Text::String>> &&);
+
   bool is_modified() const;
   std::vector<TextSlice> chunks() const;
 
@@ -47,10 +92,97 @@ public:
   void serialize_changes(Serializer &);
   bool deserialize_changes(Deserializer &);
   const Text &base_text() const;
+  size_t base_text_digest() const;
 
   optional<Range> find(const Regex &) const;
   std::vector<Range> find_all(const Regex &) const;
 
+  // Walks the chunks of text in a range without copying them. Iterators are
+  // invalidated by any change to the buffer, but iterators created from a
+  // snapshot remain valid for as long as that snapshot exists.
+  class ChunkIterator {
+    friend class TextBuffer;
+
+    // Either a range of a layer's text or, if `layer` is null, a chunk.
+    struct Segment {
+      Layer *layer;
+      Range range;
+      TextSlice chunk;
+    };
+
+    Layer *layer;
+    Point position;
+    std::vector<Segment> pending_segments;
+    TextSlice chunk;
+
+    ChunkIterator(Layer *, Range);
+    void load_chunk();
+
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef TextSlice value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const TextSlice *pointer;
+    typedef const TextSlice &reference;
+
+    ChunkIterator();
+    const TextSlice &operator*() const { return chunk; }
+    const TextSlice *operator->() const { return &chunk; }
+    ChunkIterator &operator++();
+    bool operator==(const ChunkIterator &) const;
+    bool operator!=(const ChunkIterator &other) const { return !(*this == other); }
+  };
+
+  // Walks lines of text, excluding their line endings. Lines that lie within
+  // a single chunk are not copied. Lines that span chunks are assembled in a
+  // buffer that is reused from one line to the next.
+  class LineIterator {
+  public:
+    struct Line {
+      uint32_t row;
+      const uint16_t *data;
+      uint32_t size;
+    };
+
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Line value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Line *pointer;
+    typedef const Line &reference;
+
+  private:
+    friend class TextBuffer;
+    ChunkIterator chunks;
+    const uint16_t *remaining_begin;
+    const uint16_t *remaining_end;
+    Text::String buffer;
+    uint32_t end_row;
+    Line line;
+
+    LineIterator(Layer *, uint32_t start_row, uint32_t end_row);
+    void load_line();
+
+  public:
+    LineIterator();
+    const Line &operator*() const { return line; }
+    const Line *operator->() const { return &line; }
+    LineIterator &operator++();
+    bool operator==(const LineIterator &) const;
+    bool operator!=(const LineIterator &other) const { return !(*this == other); }
+  };
+
+  ChunkIterator chunk_iterator(Range) const;
+  LineIterator line_iterator(uint32_t start_row, uint32_t end_row) const;
+
+  // Concatenates the lines in the given rows, excluding their line endings.
+  // The offset at which each line starts is appended to `line_start_offsets`,
+  // followed by the size of the result.
+  Text::String lines_in_rows(uint32_t start_row, uint32_t end_row,
+                             std::vector<uint32_t> *line_start_offsets) const;
+
+  // A snapshot's const methods can be called concurrently from any number of
+  // threads, while the buffer keeps being edited. Creating, flushing and
+  // deleting snapshots must happen on the thread that owns the buffer.
   class Snapshot {
     friend class TextBuffer;
     TextBuffer &buffer;
@@ -62,6 +194,8 @@ public:
   public:
     ~Snapshot();
     void flush_preceding_changes();
+    void flush_preceding_changes(Text &&);
+    Text compute_preceding_text() const;
 
     uint32_t size() const;
     Point extent() const;
@@ -70,18 +204,89 @@ public:
     std::vector<TextSlice> chunks_in_range(Range) const;
     Text::String text() const;
     Text::String text_in_range(Range) const;
+    uint32_t copy_text_in_range(Range, uint16_t *buffer, size_t capacity) const;
+    void copy_text_in_range(Range, uint16_t *buffer, size_t capacity,
+                            const std::function<bool(uint32_t)> &callback) const;
     const Text &base_text() const;
     optional<Range> find(const Regex &) const;
+    ChunkIterator chunk_iterator(Range) const;
+    LineIterator line_iterator(uint32_t start_row, uint32_t end_row) const;
   };
 
   friend class Snapshot;
   Snapshot *create_snapshot();
 
+  // Returns a new buffer with the same text as this one, which can then be
+  // edited independently. Like a snapshot, the fork pins this buffer's layers
+  // instead of copying them, so it costs O(1) until it's edited, and it must
+  // be deleted before this buffer is. Resetting the fork releases them. Reading
+  // the shared layers fills their caches, so unlike a snapshot, the fork must
+  // only be used on the thread that owns this buffer.
+  TextBuffer *fork();
+
+  // A checkpoint holds a snapshot of the buffer, so its text can be restored
+  // from the layers it pins rather than from a copy of every replaced range.
+  // Reverting to a checkpoint is itself an edit, and discards the checkpoints
+  // created after it. Grouping the changes since a checkpoint discards those
+  // checkpoints as well, so that their layers can be squashed. Creating a
+  // checkpoint evicts the oldest ones while the layers recorded since the
+  // first of them use more than CHECKPOINT_MEMORY_BUDGET bytes. Reverting to
+  // an evicted checkpoint fails.
+  uint32_t create_checkpoint();
+  bool revert_to_checkpoint(uint32_t);
+  bool group_changes_since(uint32_t);
+
   bool is_modified(const Snapshot *) const;
   Patch get_inverted_changes(const Snapshot *) const;
 
+  // Returns the changes that turn the text of the first snapshot into the
+  // text of the second one, including their old and new text. Only the layers
+  // between the two snapshots are visited, so the cost depends on the size of
+  // the edits rather than the size of the buffer. Either snapshot may be the
+  // older one.
+  Patch changes_between(const Snapshot *, const Snapshot *) const;
+
+  struct LayerStatistics {
+    size_t layer_count;
+    size_t read_depth;
+    size_t change_count;
+  };
+
+  struct LayerMemoryUsage {
+    bool is_base_layer;
+    uint32_t snapshot_count;
+    size_t text_bytes;
+    Patch::MemoryUsage patch;
+  };
+
   size_t layer_count()  const;
+  LayerStatistics layer_statistics() const;
+  std::vector<LayerMemoryUsage> memory_usage() const;
   std::string get_dot_graph() const;
+
+private:
+  // The snapshot of the buffer that this one was forked from. Its layers are
+  // shared with that buffer, so they are read through but never modified or
+  // freed by this one.
+  Snapshot *origin;
+  TextBuffer(Snapshot *origin);
+  Layer *shared_layer() const;
+
+  // Each checkpoint is charged for the patches of the layers above the
+  // previous checkpoint when it is created, and for the text of a checkpoint
+  // layer that it keeps alive once another one is materialized above it. The
+  // charges of the remaining checkpoints are kept in a running total.
+  struct Checkpoint {
+    uint32_t id;
+    Snapshot *snapshot;
+    size_t memory_usage;
+  };
+  std::vector<Checkpoint> checkpoints;
+  uint32_t next_checkpoint_id;
+  size_t checkpoint_memory_usage;
+  std::vector<Checkpoint>::iterator find_checkpoint(uint32_t id);
+  void delete_checkpoints(std::vector<Checkpoint>::iterator begin,
+                          std::vector<Checkpoint>::iterator end);
 };
 
 #endif  // SUPERSTRING_TEXT_BUFFER_H_
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "text.h"
 #include <algorithm>
+#include <cstring>
+#include "newline-scanner.h"
 #include "text-slice.h"
 
 using std::function;
@@ -8,14 +10,21 @@ using std::ostream;
 using std::vector;
 using String = Text::String;
 
+// Vectors grow geometrically, so after indexing a large text the line offsets
+// can have up to as much unused capacity as they have entries.
+static const size_t MAX_UNUSED_LINE_OFFSETS = 4096;
+
+static void index_lines(vector<uint32_t> &line_offsets, const String &content) {
+  append_line_offsets(line_offsets, content.data(), content.data() + content.size());
+  if (line_offsets.capacity() - line_offsets.size() > MAX_UNUSED_LINE_OFFSETS) {
+    line_offsets.shrink_to_fit();
+  }
+}
+
 Text::Text() : line_offsets{0} {}
 
 Text::Text(vector<uint16_t> &&content) : content{move(content)}, line_offsets{0} {
-  for (uint32_t offset = 0, size = this->content.size(); offset < size; offset++) {
-    if (this->content[offset] == '\n') {
-      line_offsets.push_back(offset + 1);
-    }
-  }
+  index_lines(line_offsets, this->content);
 }
 
 Text::Text(const std::u16string &string) :
@@ -46,10 +55,9 @@ Text::Text(Deserializer &deserializer) : line_offsets{0} {
   uint32_t size = deserializer.read<uint32_t>();
   content.reserve(size);
   for (uint32_t offset = 0; offset < size; offset++) {
-    uint16_t character = deserializer.read<uint16_t>();
-    content.push_back(character);
-    if (character == '\n') line_offsets.push_back(offset + 1);
+    content.push_back(deserializer.read<uint16_t>());
   }
+  index_lines(line_offsets, content);
 }
 
 void Text::serialize(Serializer &serializer) const {
@@ -74,6 +82,7 @@ Point Text::extent(const std::u16string &string) {
 
 Text Text::concat(TextSlice a, TextSlice b) {
   Text result;
+  result.reserve(a.size() + b.size(), a.extent().row + b.extent().row + 1);
   result.append(a);
   result.append(b);
   return result;
@@ -81,6 +90,10 @@ Text Text::concat(TextSlice a, TextSlice b) {
 
 Text Text::concat(TextSlice a, TextSlice b, TextSlice c) {
   Text result;
+  result.reserve(
+    a.size() + b.size() + c.size(),
+    a.extent().row + b.extent().row + c.extent().row + 1
+  );
   result.append(a);
   result.append(b);
   result.append(c);
@@ -162,6 +175,7 @@ void Text::splice(Point start, Point deletion_extent, TextSlice inserted_slice)
 
   uint32_t content_size = content.size();
   int64_t trailing_line_offsets_delta = static_cast<int64_t>(content_size) - original_content_size;
+  if (trailing_line_offsets_delta == 0) return;
   for (auto iter = line_offsets.begin() + inserted_newlines_end; iter != line_offsets.end(); ++iter) {
     *iter += trailing_line_offsets_delta;
   }
@@ -235,6 +249,54 @@ const uint16_t *Text::data() const {
   return content.data();
 }
 
+static inline bool is_leading_surrogate(uint16_t code_unit) {
+  return (code_unit & 0xFC00) == 0xD800;
+}
+
+static inline bool is_trailing_surrogate(uint16_t code_unit) {
+  return (code_unit & 0xFC00) == 0xDC00;
+}
+
+// Written without branches, so that loops over many code units vectorize.
+static inline uint32_t utf8_size_of(uint16_t code_unit) {
+  return 1 + (code_unit >= 0x80) + (code_unit >= 0x800) - ((code_unit & 0xF800) == 0xD800);
+}
+
+EncodedSize EncodedSize::of(const uint16_t *begin, const uint16_t *end) {
+  uint32_t utf8_size = 0, trailing_surrogate_count = 0;
+  for (const uint16_t *pointer = begin; pointer != end; ++pointer) {
+    utf8_size += utf8_size_of(*pointer);
+    trailing_surrogate_count += is_trailing_surrogate(*pointer);
+  }
+  return EncodedSize(utf8_size, (end - begin) - trailing_surrogate_count);
+}
+
+uint32_t EncodedSize::prefix_size(const uint16_t *begin, const uint16_t *end,
+                                  uint32_t EncodedSize::*unit, uint32_t size) {
+  EncodedSize prefix_size;
+  const uint16_t *pointer = begin;
+  for (; pointer != end; ++pointer) {
+    EncodedSize code_unit_size(utf8_size_of(*pointer), is_trailing_surrogate(*pointer) ? 0 : 1);
+    if (prefix_size.*unit + code_unit_size.*unit > size) break;
+    prefix_size += code_unit_size;
+  }
+  if (pointer != begin && pointer != end &&
+      is_trailing_surrogate(*pointer) && is_leading_surrogate(*(pointer - 1))) {
+    --pointer;
+  }
+  return pointer - begin;
+}
+
+EncodedSize Text::encoded_size() const {
+  return EncodedSize::of(content.data(), content.data() + content.size());
+}
+
+// The number of bytes allocated for this text's content and line offsets,
+// not counting the `Text` object itself.
+size_t Text::memory_usage() const {
+  return content.capacity() * sizeof(uint16_t) + line_offsets.capacity() * sizeof(uint32_t);
+}
+
 Point Text::extent() const {
   return Point(line_offsets.size() - 1, content.size() - line_offsets.back());
 }
@@ -243,18 +305,80 @@ bool Text::empty() const {
   return content.empty();
 }
 
-template <typename T>
-inline void hash_combine(std::size_t &seed, const T &value) {
-  std::hash<T> hasher;
-  seed ^= hasher(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+static const uint64_t PRIME_1 = 11400714785074694791ULL;
+static const uint64_t PRIME_2 = 14029467366897019727ULL;
+static const uint64_t PRIME_3 = 1609587929392839161ULL;
+static const uint64_t PRIME_4 = 9650029242287828579ULL;
+static const uint64_t PRIME_5 = 2870177450012600261ULL;
+
+static inline uint64_t rotate_left(uint64_t value, int count) {
+  return (value << count) | (value >> (64 - count));
+}
+
+static inline uint64_t read_lane(const uint16_t *pointer) {
+  uint64_t result;
+  std::memcpy(&result, pointer, sizeof(result));
+  return result;
 }
 
+static inline uint64_t hash_round(uint64_t accumulator, uint64_t lane) {
+  return rotate_left(accumulator + lane * PRIME_2, 31) * PRIME_1;
+}
+
+static inline uint64_t merge_round(uint64_t hash, uint64_t accumulator) {
+  return (hash ^ hash_round(0, accumulator)) * PRIME_1 + PRIME_4;
+}
+
+// An xxHash64-style hash of the content. Four independent accumulators
+// consume 32 bytes per step, so the loop isn't bound by the latency of a
+// single multiply chain.
 size_t Text::digest() const {
-  size_t result = 0;
-  for (uint16_t character : content) {
-    hash_combine(result, character);
+  const uint16_t *pointer = content.data();
+  const uint16_t *end = pointer + content.size();
+  uint64_t result;
+
+  if (end - pointer >= 16) {
+    uint64_t accumulator_1 = PRIME_1 + PRIME_2;
+    uint64_t accumulator_2 = PRIME_2;
+    uint64_t accumulator_3 = 0;
+    uint64_t accumulator_4 = 0 - PRIME_1;
+    do {
+      accumulator_1 = hash_round(accumulator_1, read_lane(pointer));
+      accumulator_2 = hash_round(accumulator_2, read_lane(pointer + 4));
+      accumulator_3 = hash_round(accumulator_3, read_lane(pointer + 8));
+      accumulator_4 = hash_round(accumulator_4, read_lane(pointer + 12));
+      pointer += 16;
+    } while (end - pointer >= 16);
+
+    result =
+      rotate_left(accumulator_1, 1) + rotate_left(accumulator_2, 7) +
+      rotate_left(accumulator_3, 12) + rotate_left(accumulator_4, 18);
+    result = merge_round(result, accumulator_1);
+    result = merge_round(result, accumulator_2);
+    result = merge_round(result, accumulator_3);
+    result = merge_round(result, accumulator_4);
+  } else {
+    result = PRIME_5;
   }
-  return result;
+
+  result += static_cast<uint64_t>(content.size()) * sizeof(uint16_t);
+
+  for (; end - pointer >= 4; pointer += 4) {
+    result ^= hash_round(0, read_lane(pointer));
+    result = rotate_left(result, 27) * PRIME_1 + PRIME_4;
+  }
+
+  for (; pointer != end; pointer++) {
+    result ^= *pointer * PRIME_5;
+    result = rotate_left(result, 11) * PRIME_1;
+  }
+
+  result ^= result >> 33;
+  result *= PRIME_2;
+  result ^= result >> 29;
+  result *= PRIME_3;
+  result ^= result >> 32;
+  return static_cast<size_t>(result);
 }
 
 void Text::append(TextSlice slice) {
@@ -298,6 +422,11 @@ void Text::assign(TextSlice slice) {
   }
 }
 
+void Text::reserve(uint32_t size, uint32_t line_count) {
+  content.reserve(size);
+  line_offsets.reserve(line_count);
+}
+
 bool Text::operator!=(const Text &other) const {
   return content != other.content;
 }
@@ -16,6 +16,52 @@ struct ClipResult {
   uint32_t offset;
 };
 
+// The size of a run of UTF-16 code units in UTF-8 bytes and in code points.
+// Both are sums over the individual code units: each half of a surrogate pair
+// counts as two bytes, and the pair counts as one code point at its leading
+// half. The size of any range is therefore the difference between the sizes
+// of the text preceding its ends, even when a change splits a pair.
+struct EncodedSize {
+  uint32_t utf8_size;
+  uint32_t code_point_count;
+
+  EncodedSize() : utf8_size{0}, code_point_count{0} {}
+  EncodedSize(uint32_t utf8_size, uint32_t code_point_count) :
+    utf8_size{utf8_size}, code_point_count{code_point_count} {}
+
+  static EncodedSize of(const uint16_t *begin, const uint16_t *end);
+
+  // Returns the number of code units at the start of the given ones whose
+  // size, measured in `unit`, doesn't exceed `size`. The result never falls
+  // between the halves of a surrogate pair.
+  static uint32_t prefix_size(const uint16_t *begin, const uint16_t *end,
+                              uint32_t EncodedSize::*unit, uint32_t size);
+
+  EncodedSize operator+(const EncodedSize &other) const {
+    return EncodedSize(utf8_size + other.utf8_size, code_point_count + other.code_point_count);
+  }
+
+  EncodedSize operator-(const EncodedSize &other) const {
+    return EncodedSize(utf8_size - other.utf8_size, code_point_count - other.code_point_count);
+  }
+
+  EncodedSize &operator+=(const EncodedSize &other) {
+    utf8_size += other.utf8_size;
+    code_point_count += other.code_point_count;
+    return *this;
+  }
+
+  EncodedSize &operator-=(const EncodedSize &other) {
+    utf8_size -= other.utf8_size;
+    code_point_count -= other.code_point_count;
+    return *this;
+  }
+
+  bool operator==(const EncodedSize &other) const {
+    return utf8_size == other.utf8_size && code_point_count == other.code_point_count;
+  }
+};
+
 class Text {
   friend class TextSlice;
 
@@ -56,10 +102,13 @@ class Text {
   uint32_t line_length_for_row(uint32_t row) const;
   void append(TextSlice);
   void assign(TextSlice);
+  void reserve(uint32_t size, uint32_t line_count);
   void serialize(Serializer &) const;
   uint32_t size() const;
   const uint16_t *data() const;
   size_t digest() const;
+  size_t memory_usage() const;
+  EncodedSize encoded_size() const;
   void clear();
 
   bool operator!=(const Text &) const;
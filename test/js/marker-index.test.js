@@ -534,4 +534,18 @@ describe('MarkerIndex', () => {
     let result = index.findEndingIn({row: 0, column: 0}, {row: Infinity, column: Infinity})
     assert(result.has(1))
   })
+
+  it('reports its memory usage', () => {
+    let index = new MarkerIndex()
+    assert.equal(index.getMemoryUsage().nodeCount, 0)
+
+    index.insert(1, {row: 1, column: 2}, {row: 3, column: 4})
+    index.insert(2, {row: 2, column: 2}, {row: 3, column: 4})
+    const memoryUsage = index.getMemoryUsage()
+    assert.equal(memoryUsage.nodeCount, 3)
+    assert(memoryUsage.nodeBytes > 0)
+    assert(memoryUsage.markerIdSetBytes > 0)
+    assert(memoryUsage.markerIdMapBytes > 0)
+    assert(memoryUsage.positionCacheBytes > 0)
+  })
 })
@@ -171,6 +171,20 @@ describe('Patch', function () {
     patch2.delete();
   })
 
+  it('reports its memory usage', () => {
+    const patch = new Patch()
+    assert.equal(patch.getMemoryUsage().nodeCount, 0)
+
+    patch.splice({row: 0, column: 3}, {row: 0, column: 4}, {row: 0, column: 5}, 'ciao', 'hello')
+    patch.splice({row: 0, column: 10}, {row: 0, column: 5}, {row: 0, column: 5}, 'quick', 'world')
+    const memoryUsage = patch.getMemoryUsage()
+    assert.equal(memoryUsage.nodeCount, 2)
+    assert(memoryUsage.nodeBytes > 0)
+    assert(memoryUsage.oldTextBytes >= 18)
+    assert(memoryUsage.newTextBytes >= 20)
+    patch.delete();
+  })
+
   it('can serialize/deserialize patches', () => {
     const emptyPatch = Patch.deserialize(new Patch().serialize())
     assert.equal(emptyPatch.getChangeCount(), 0)
@@ -520,6 +520,31 @@ describe('TextBuffer', () => {
       })
     })
 
+    it('can flush the saved changes on a background thread', () => {
+      const buffer = new TextBuffer('abc def ghi jkl\n'.repeat(10 * 1024))
+      buffer.setTextInRange(Range(Point(10, 15), Point(10, 15)), ' mno')
+      const savedText = buffer.getText()
+
+      const {path: filePath1} = temp.openSync()
+      const {path: filePath2} = temp.openSync()
+      const savePromise = buffer.save(filePath1, {flushInBackground: true})
+
+      buffer.setTextInRange(Range(Point(20, 15), Point(20, 15)), ' mno')
+      const modifiedText = buffer.getText()
+
+      return savePromise.then(() => {
+        assert.equal(fs.readFileSync(filePath1, 'utf8'), savedText)
+        assert.equal(buffer.getText(), modifiedText)
+        assert(buffer.isModified())
+
+        return buffer.save(fs.createWriteStream(filePath2), {flushInBackground: true}).then(() => {
+          assert.equal(fs.readFileSync(filePath2, 'utf8'), modifiedText)
+          assert.equal(buffer.getText(), modifiedText)
+          assert(!buffer.isModified())
+        })
+      })
+    })
+
     it('can handle a variety of encodings', () => {
       const {path: filePath} = temp.openSync()
 
@@ -614,6 +639,28 @@ describe('TextBuffer', () => {
     })
   })
 
+  describe('.setTextInRanges', () => {
+    it('replaces every range of the original text', () => {
+      const buffer = new TextBuffer('abc\ndef\nghi')
+
+      buffer.setTextInRanges([
+        Range(Point(2, 0), Point(2, 1)),
+        Range(Point(0, 1), Point(0, 2)),
+        Range(Point(1, 1), Point(1, 1))
+      ], ['G', 'B\nb', 'x'])
+      assert.equal(buffer.getText(), 'aB\nbc\ndxef\nGhi')
+      assert.equal(buffer.isModified(), true)
+
+      buffer.setTextInRanges([
+        Range(Point(0, 1), Point(1, 0)),
+        Range(Point(2, 1), Point(2, 2)),
+        Range(Point(3, 0), Point(3, 1))
+      ], ['', '', 'g'])
+      assert.equal(buffer.getText(), 'abc\ndef\nghi')
+      assert.equal(buffer.isModified(), false)
+    })
+  })
+
   describe('.getTextInRange', () => {
     it('reads substrings from the buffer', () => {
       const buffer = new TextBuffer()
@@ -658,6 +705,37 @@ describe('TextBuffer', () => {
     })
   })
 
+  describe('.getLongestRow', () => {
+    it('returns the first of the rows with the longest line', () => {
+      const buffer = new TextBuffer('abc\r\ndefg\n\r\nhijkl\n\n')
+      assert.equal(buffer.getLongestRow(), 3)
+
+      buffer.setTextInRange(Range(Point(1, 1), Point(1, 2)), 'EEE')
+      assert.equal(buffer.getLongestRow(), 1)
+
+      buffer.setTextInRange(Range(Point(3, 0), Point(3, 0)), 'x')
+      assert.equal(buffer.getLongestRow(), 1)
+
+      buffer.setTextInRange(Range(Point(4, 0), Point(4, 0)), 'abcdefg')
+      assert.equal(buffer.getLongestRow(), 4)
+    })
+  })
+
+  describe('.getLinesInRows', () => {
+    it('returns the text of the given rows without line endings, along with the offset at which each line starts', () => {
+      const buffer = new TextBuffer('abc\r\ndefg\n\r\nhijkl\n\n')
+      buffer.setTextInRange(Range(Point(1, 1), Point(1, 2)), 'EEE')
+
+      const {text, lineStartOffsets} = buffer.getLinesInRows(1, 4)
+      assert.equal(text, 'dEEEfghijkl')
+      assert.deepEqual(Array.from(lineStartOffsets), [0, 6, 6, 11])
+
+      const lines = buffer.getLinesInRows(0, buffer.getLineCount())
+      assert.equal(lines.text, 'abcdEEEfghijkl')
+      assert.deepEqual(Array.from(lines.lineStartOffsets), [0, 3, 9, 9, 14, 14, 14])
+    })
+  })
+
   describe('.getLength, .getExtent, and .getLineCount', () => {
     it('returns the total length and total extent of the text', () => {
       const buffer = new TextBuffer()
@@ -694,6 +772,32 @@ describe('TextBuffer', () => {
     })
   })
 
+  describe('.utf8OffsetForPosition and .positionForUtf8Offset', () => {
+    it('converts between positions and offsets in UTF-8 bytes', () => {
+      const buffer = new TextBuffer('abc\r\ndéf\nghi')
+      buffer.setTextInRange(Range(Point(0, 1), Point(0, 2)), 'é')
+
+      assert.equal(buffer.utf8OffsetForPosition(Point(0, 2)), 3)
+      assert.equal(buffer.utf8OffsetForPosition(Point(0, 4)), 4)
+      assert.equal(buffer.utf8OffsetForPosition(Point(1, 2)), 9)
+      assert.equal(buffer.utf8OffsetForPosition(Point(2, 0)), 11)
+
+      assert.deepEqual(buffer.positionForUtf8Offset(1), Point(0, 1))
+      assert.deepEqual(buffer.positionForUtf8Offset(2), Point(0, 1))
+      assert.deepEqual(buffer.positionForUtf8Offset(3), Point(0, 2))
+      assert.deepEqual(buffer.positionForUtf8Offset(8), Point(1, 1))
+      assert.deepEqual(buffer.positionForUtf8Offset(9), Point(1, 2))
+      assert.deepEqual(buffer.positionForUtf8Offset(11), Point(2, 0))
+      assert.deepEqual(buffer.positionForUtf8Offset(100), Point(2, 3))
+      assert.deepEqual(buffer.positionForUtf8Offset(Math.pow(2, 32) + 1), Point(2, 3))
+      assert.deepEqual(buffer.positionForUtf8Offset(-1), Point(0, 0))
+
+      assert.equal(buffer.codePointOffsetForPosition(Point(1, 2)), 7)
+      assert.deepEqual(buffer.positionForCodePointOffset(7), Point(1, 2))
+      assert.deepEqual(buffer.positionForCodePointOffset(Math.pow(2, 32) + 1), Point(2, 3))
+    })
+  })
+
   describe('.baseTextDigest', () => {
     if (!TextBuffer.prototype.baseTextDigest) return
 
@@ -851,6 +955,55 @@ describe('TextBuffer', () => {
     })
   })
 
+  describe('.createCheckpoint and .revertToCheckpoint', () => {
+    it('restores the text of earlier checkpoints', () => {
+      const buffer = new TextBuffer('abc')
+      const checkpoint1 = buffer.createCheckpoint()
+      buffer.setTextInRange(Range(Point(0, 1), Point(0, 2)), 'B')
+      const checkpoint2 = buffer.createCheckpoint()
+      buffer.setTextInRange(Range(Point(0, 3), Point(0, 3)), '\ndef')
+      const checkpoint3 = buffer.createCheckpoint()
+      buffer.setTextInRange(Range(Point(0, 0), Point(0, 0)), 'x')
+      assert.equal(buffer.getText(), 'xaBc\ndef')
+
+      assert.ok(buffer.revertToCheckpoint(checkpoint3))
+      assert.equal(buffer.getText(), 'aBc\ndef')
+
+      assert.ok(buffer.groupChangesSince(checkpoint1))
+      assert.notOk(buffer.revertToCheckpoint(checkpoint2))
+      assert.ok(buffer.revertToCheckpoint(checkpoint1))
+      assert.equal(buffer.getText(), 'abc')
+    })
+  })
+
+  describe('.getLayerStatistics', () => {
+    it('reports the number of layers and the changes that reads pass through', () => {
+      const buffer = new TextBuffer('abc')
+      assert.deepEqual(buffer.getLayerStatistics(), {layerCount: 1, readDepth: 0, changeCount: 0})
+
+      buffer.setTextInRange(Range(Point(0, 0), Point(0, 0)), '1')
+      buffer.setTextInRange(Range(Point(0, 3), Point(0, 3)), '2')
+      assert.deepEqual(buffer.getLayerStatistics(), {layerCount: 2, readDepth: 1, changeCount: 2})
+    })
+  })
+
+  describe('.getMemoryUsage', () => {
+    it('reports the memory used by each layer, starting with the bottom-most one', () => {
+      const buffer = new TextBuffer('abc')
+      buffer.setTextInRange(Range(Point(0, 1), Point(0, 2)), 'BBB')
+
+      const layers = buffer.getMemoryUsage()
+      assert.equal(layers.length, 2)
+      assert.equal(layers[0].isBaseLayer, true)
+      assert(layers[0].textBytes >= 6)
+      assert.equal(layers[0].patch.nodeCount, 0)
+      assert.equal(layers[1].isBaseLayer, false)
+      assert.equal(layers[1].textBytes, 0)
+      assert.equal(layers[1].patch.nodeCount, 1)
+      assert(layers[1].patch.newTextBytes > 0)
+    })
+  })
+
   describe('concurrent IO', function () {
     if (!TextBuffer.prototype.load) return;
 
@@ -309,3 +309,114 @@ TEST_CASE("Patch::serialize") {
     }
   }));
 }
+
+TEST_CASE("Patch::serialize - version 1 data") {
+  // Written by an earlier release. Serialized patches are persisted by
+  // editors, so they must keep reading and writing exactly this format.
+  vector<uint8_t> bytes {
+    1, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+    2, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 0, 2, 0, 0, 0, 181, 3, 102, 0, 1, 0, 0, 0,
+    0, 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
+    0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0,
+    1, 0, 0, 0, 2, 0, 0, 0, 98, 0, 99, 0, 1, 0, 0, 0,
+    3, 0, 0, 0, 233, 0, 10, 0, 120, 0, 3, 0, 0, 0,
+  };
+
+  Deserializer deserializer(bytes);
+  Patch patch(deserializer);
+  REQUIRE(patch.get_changes() == vector<Change>({
+    Change {
+      Point {0, 1}, Point {0, 3},
+      Point {0, 1}, Point {1, 1},
+      get_text(u"bc").get(), get_text(u"é\nx").get(),
+      0, 0, 0
+    },
+    Change {
+      Point {1, 0}, Point {1, 0},
+      Point {2, 0}, Point {2, 2},
+      get_text(u"").get(), get_text(u"εf").get(),
+      0, 0, 0
+    },
+  }));
+
+  vector<uint8_t> reserialized_bytes;
+  Serializer serializer(reserialized_bytes);
+  patch.serialize(serializer);
+  REQUIRE(reserialized_bytes == bytes);
+}
+
+TEST_CASE("Patch::combine - moving texts out of a temporary patch") {
+  Patch patch1;
+  patch1.splice(Point {0, 2}, Point {0, 1}, Point {0, 3}, Text {u"c"}, Text {u"xyz"});
+  patch1.splice(Point {1, 0}, Point {0, 2}, Point {0, 0}, Text {u"gh"}, Text {u""});
+
+  Patch patch2;
+  patch2.splice(Point {0, 3}, Point {0, 1}, Point {1, 0}, Text {u"y"}, Text {u"\n"});
+  patch2.splice(Point {2, 0}, Point {0, 0}, Point {0, 2}, Text {u""}, Text {u"uv"});
+
+  Patch copied_combination = patch1.copy();
+  copied_combination.combine(patch2);
+  REQUIRE(*patch2.get_changes()[0].new_text == Text {u"\n"});
+
+  Patch moved_combination = patch1.copy();
+  moved_combination.combine(std::move(patch2));
+  REQUIRE(moved_combination.get_changes() == copied_combination.get_changes());
+  REQUIRE(*moved_combination.get_changes()[0].new_text == Text {u"x\nz"});
+}
+
+TEST_CASE("Patch::memory_usage") {
+  Patch patch;
+  REQUIRE(patch.memory_usage().node_count == 0);
+  REQUIRE(patch.memory_usage().old_text_bytes == 0);
+  REQUIRE(patch.memory_usage().new_text_bytes == 0);
+
+  patch.splice(Point {0, 2}, Point {0, 1}, Point {0, 3}, Text {u"c"}, Text {u"xyz"});
+  patch.splice(Point {1, 0}, Point {0, 2}, Point {0, 0}, Text {u"gh"}, Text {u""});
+
+  auto memory_usage = patch.memory_usage();
+  REQUIRE(memory_usage.node_count == 2);
+  REQUIRE(memory_usage.node_bytes > 0);
+  REQUIRE(memory_usage.old_text_bytes >= 2 * sizeof(Text) + 3 * sizeof(uint16_t));
+  REQUIRE(memory_usage.new_text_bytes >= 2 * sizeof(Text) + 3 * sizeof(uint16_t));
+
+  Patch copy = patch.copy();
+  REQUIRE(copy.memory_usage().node_count == 2);
+  REQUIRE(copy.memory_usage().new_text_bytes == memory_usage.new_text_bytes);
+}
+
+TEST_CASE("Patch::clear - releasing node memory") {
+  Patch patch;
+  for (uint32_t i = 0; i < 5000; i++) {
+    patch.splice(Point {i, 0}, Point {0, 1}, Point {0, 2});
+  }
+  REQUIRE(patch.memory_usage().node_count == 5000);
+  size_t node_bytes = patch.memory_usage().node_bytes;
+  REQUIRE(node_bytes >= 5000 * sizeof(Point) * 4);
+
+  patch.clear();
+  REQUIRE(patch.get_change_count() == 0);
+  REQUIRE(patch.memory_usage().node_bytes < node_bytes / 100);
+
+  patch.splice(Point {0, 0}, Point {0, 1}, Point {0, 2});
+  REQUIRE(patch.get_change_count() == 1);
+}
+
+TEST_CASE("Patch::splice - editing multi-line text of an existing change") {
+  Patch patch;
+  patch.splice(Point {1, 0}, Point {0, 0}, Point {2, 2}, Text {u""}, Text {u"ab\r\ncd\nef"});
+
+  // Inserting in the middle of the change
+  patch.splice(Point {2, 0}, Point {0, 1}, Point {1, 1}, Text {u"c"}, Text {u"x\ny"});
+  // Appending to the end of the change
+  patch.splice(Point {4, 2}, Point {0, 0}, Point {1, 0}, Text {u""}, Text {u"\n"});
+  // Deleting from the start of the change
+  patch.splice(Point {1, 0}, Point {1, 0}, Point {0, 0}, Text {u"ab\r\n"}, Text {u""});
+
+  auto changes = patch.get_changes();
+  REQUIRE(changes.size() == 1);
+  REQUIRE(*changes[0].new_text == Text {u"x\nyd\nef\n"});
+  REQUIRE(changes[0].new_text->line_offsets == Text {u"x\nyd\nef\n"}.line_offsets);
+  REQUIRE(changes[0].new_end == Point(4, 0));
+}
@@ -0,0 +1,65 @@
+#include "test-helpers.h"
+#include "slab-allocator.h"
+
+using std::vector;
+
+struct Counted {
+  uint32_t *live_count;
+  uint32_t value;
+
+  Counted(uint32_t *live_count, uint32_t value) : live_count{live_count}, value{value} {
+    (*live_count)++;
+  }
+
+  ~Counted() {
+    (*live_count)--;
+  }
+};
+
+TEST_CASE("SlabAllocator - reusing the slots of destroyed objects") {
+  SlabAllocator<Counted> allocator;
+  uint32_t live_count = 0;
+
+  vector<Counted *> objects;
+  for (uint32_t i = 0; i < 100; i++) {
+    objects.push_back(allocator.create(&live_count, i));
+  }
+  REQUIRE(live_count == 100);
+  for (uint32_t i = 0; i < 100; i++) REQUIRE(objects[i]->value == i);
+
+  size_t memory_usage = allocator.memory_usage();
+  REQUIRE(memory_usage >= 100 * sizeof(Counted));
+
+  Counted *destroyed_object = objects[42];
+  allocator.destroy(destroyed_object);
+  REQUIRE(live_count == 99);
+  objects[42] = allocator.create(&live_count, 1000);
+  REQUIRE(objects[42] == destroyed_object);
+  REQUIRE(objects[42]->value == 1000);
+
+  for (Counted *object : objects) allocator.destroy(object);
+  REQUIRE(live_count == 0);
+  for (uint32_t i = 0; i < 100; i++) allocator.create(&live_count, i);
+  REQUIRE(allocator.memory_usage() == memory_usage);
+}
+
+TEST_CASE("SlabAllocator - releasing blocks") {
+  SlabAllocator<Counted> allocator;
+  uint32_t live_count = 0;
+  size_t initial_memory_usage = allocator.memory_usage();
+
+  vector<Counted *> objects;
+  for (uint32_t i = 0; i < 5000; i++) {
+    objects.push_back(allocator.create(&live_count, i));
+  }
+  REQUIRE(allocator.memory_usage() > initial_memory_usage);
+
+  for (Counted *object : objects) allocator.destroy(object);
+  allocator = SlabAllocator<Counted>();
+  REQUIRE(allocator.memory_usage() == initial_memory_usage);
+
+  Counted *object = allocator.create(&live_count, 7);
+  REQUIRE(object->value == 7);
+  allocator.destroy(object);
+  REQUIRE(live_count == 0);
+}
@@ -15,6 +15,22 @@ using std::u16string;
 using MatchResult = Regex::MatchResult;
 using String = Text::String;
 
+// Overrides one of TextBuffer's static tuning parameters until the end of the
+// enclosing scope, so that a failing REQUIRE can't leak it into other tests.
+template <typename T>
+struct ScopedSetting {
+  T &setting;
+  T original_value;
+
+  ScopedSetting(T &setting, T value) : setting{setting}, original_value{setting} {
+    setting = value;
+  }
+
+  ~ScopedSetting() {
+    setting = original_value;
+  }
+};
+
 TEST_CASE("TextBuffer::set_text_in_range - basic") {
   TextBuffer buffer{u"abc\ndef\nghi"};
   REQUIRE(buffer.text_in_range({{0, 1}, {0, UINT32_MAX}}) == u"bc");
@@ -28,12 +44,214 @@ TEST_CASE("TextBuffer::set_text_in_range - basic") {
   REQUIRE(buffer.text_in_range(Range {{0, 1}, {10, 1}}) == u"z");
 }
 
+TEST_CASE("TextBuffer::set_text_in_ranges") {
+  TextBuffer buffer{u"abc\ndef\nghi"};
+
+  vector<pair<Range, String>> changes;
+  auto add_change = [&changes](Range range, u16string text) {
+    changes.push_back({range, String(text.begin(), text.end())});
+  };
+
+  add_change(Range{{2, 0}, {2, 1}}, u"G");
+  add_change(Range{{0, 1}, {0, 2}}, u"B\nb");
+  add_change(Range{{1, 2}, {1, 3}}, u"f");
+  add_change(Range{{1, 1}, {1, 1}}, u"x");
+  add_change(Range{{0, 1}, {0, 1}}, u"_");
+  buffer.set_text_in_ranges(move(changes));
+
+  REQUIRE(buffer.text() == u"a_B\nbc\ndxef\nGhi");
+  REQUIRE(buffer.extent() == Point(3, 3));
+  REQUIRE(buffer.size() == 15);
+  REQUIRE(buffer.layer_count() == 2);
+
+  changes.clear();
+  add_change(Range{{3, 0}, {3, 1}}, u"g");
+  add_change(Range{{1, 0}, {1, 1}}, u"b");
+  add_change(Range{{0, 1}, {1, 0}}, u"");
+  add_change(Range{{2, 1}, {2, 2}}, u"");
+  buffer.set_text_in_ranges(move(changes));
+
+  REQUIRE(buffer.text() == u"abc\ndef\nghi");
+  REQUIRE(!buffer.is_modified());
+}
+
+TEST_CASE("TextBuffer::chunk_iterator and ::line_iterator") {
+  TextBuffer buffer{u"abc\r\ndef\nghi"};
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"B");
+  buffer.set_text_in_range({{1, 3}, {1, 3}}, u"\r");
+  buffer.set_text_in_range({{2, 0}, {2, 0}}, u"\nG");
+  REQUIRE(buffer.text() == u"aBc\r\ndef\r\n\nGghi");
+
+  vector<String> chunks;
+  for (auto iter = buffer.chunk_iterator({{0, 0}, {3, 4}}); iter != TextBuffer::ChunkIterator(); ++iter) {
+    chunks.push_back(String(iter->begin(), iter->end()));
+  }
+  REQUIRE(chunks == (vector<String>{
+    Text{u"a"}.content,
+    Text{u"B"}.content,
+    Text{u"c\r\ndef"}.content,
+    Text{u"\r"}.content,
+    Text{u"\n"}.content,
+    Text{u"\nG"}.content,
+    Text{u"ghi"}.content,
+  }));
+
+  vector<u16string> lines;
+  for (auto iter = buffer.line_iterator(1, 10); iter != TextBuffer::LineIterator(); ++iter) {
+    lines.push_back(u16string(iter->data, iter->data + iter->size));
+  }
+  REQUIRE(lines == (vector<u16string>{u"def", u"", u"Gghi"}));
+
+  auto snapshot = buffer.create_snapshot();
+  buffer.set_text(u"");
+  auto iter = snapshot->line_iterator(0, 2);
+  REQUIRE(u16string(iter->data, iter->data + iter->size) == u"aBc");
+  ++iter;
+  REQUIRE(u16string(iter->data, iter->data + iter->size) == u"def");
+  ++iter;
+  REQUIRE(iter == TextBuffer::LineIterator());
+  delete snapshot;
+}
+
+TEST_CASE("TextBuffer::lines_in_rows") {
+  TextBuffer buffer{u"abc\r\ndef\nghi\n"};
+  buffer.set_text_in_range({{1, 1}, {1, 2}}, u"EEE\r\n");
+
+  vector<uint32_t> line_start_offsets;
+  REQUIRE(buffer.lines_in_rows(1, 4, &line_start_offsets) == Text{u"dEEEfghi"}.content);
+  REQUIRE(line_start_offsets == (vector<uint32_t>{0, 4, 5, 8}));
+
+  line_start_offsets.clear();
+  REQUIRE(buffer.lines_in_rows(0, UINT32_MAX, &line_start_offsets) == Text{u"abcdEEEfghi"}.content);
+  REQUIRE(line_start_offsets == (vector<uint32_t>{0, 3, 7, 8, 11, 11}));
+
+  line_start_offsets.clear();
+  REQUIRE(buffer.lines_in_rows(2, 2, &line_start_offsets).empty());
+  REQUIRE(line_start_offsets == (vector<uint32_t>{0}));
+
+  // Line endings whose carriage return and newline are in different chunks
+  TextBuffer buffer2{u"ab\ncd\r"};
+  buffer2.set_text_in_range({{0, 2}, {0, 2}}, u"x\r");
+  line_start_offsets.clear();
+  REQUIRE(buffer2.lines_in_rows(0, 2, &line_start_offsets) == Text{u"abxcd\r"}.content);
+  REQUIRE(line_start_offsets == (vector<uint32_t>{0, 3, 6}));
+}
+
+TEST_CASE("TextBuffer::copy_text_in_range") {
+  TextBuffer buffer{u"abc\r\ndef\nghi"};
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"B");
+  buffer.set_text_in_range({{1, 3}, {1, 3}}, u"\r");
+  buffer.set_text_in_range({{2, 0}, {2, 0}}, u"\nG");
+  REQUIRE(buffer.text() == u"aBc\r\ndef\r\n\nGghi");
+
+  uint16_t buffer_storage[32];
+  REQUIRE(buffer.copy_text_in_range({{0, 1}, {3, 2}}, buffer_storage, 32) == 12);
+  REQUIRE(String(buffer_storage, buffer_storage + 12) == Text{u"Bc\r\ndef\r\n\nGg"}.content);
+
+  REQUIRE(buffer.copy_text_in_range({{0, 1}, {3, 2}}, buffer_storage, 5) == 5);
+  REQUIRE(String(buffer_storage, buffer_storage + 5) == Text{u"Bc\r\nd"}.content);
+
+  REQUIRE(buffer.copy_text_in_range({{1, 0}, {1, 0}}, buffer_storage, 32) == 0);
+
+  vector<String> pieces;
+  buffer.copy_text_in_range({{0, 0}, {3, 3}}, buffer_storage, 6, [&](uint32_t size) {
+    pieces.push_back(String(buffer_storage, buffer_storage + size));
+    return false;
+  });
+  REQUIRE(pieces == (vector<String>{
+    Text{u"aBc\r\nd"}.content,
+    Text{u"ef\r\n\nG"}.content,
+    Text{u"gh"}.content,
+  }));
+
+  pieces.clear();
+  buffer.copy_text_in_range({{0, 0}, {3, 3}}, buffer_storage, 4, [&](uint32_t size) {
+    pieces.push_back(String(buffer_storage, buffer_storage + size));
+    return pieces.size() == 2;
+  });
+  REQUIRE(pieces == (vector<String>{
+    Text{u"aBc\r"}.content,
+    Text{u"\ndef"}.content,
+  }));
+
+  auto snapshot = buffer.create_snapshot();
+  buffer.set_text(u"");
+  REQUIRE(snapshot->copy_text_in_range({{1, 0}, {3, 3}}, buffer_storage, 32) == 9);
+  REQUIRE(String(buffer_storage, buffer_storage + 9) == Text{u"def\r\n\nGgh"}.content);
+
+  String streamed_text;
+  snapshot->copy_text_in_range({{0, 0}, snapshot->extent()}, buffer_storage, 3, [&](uint32_t size) {
+    streamed_text.insert(streamed_text.end(), buffer_storage, buffer_storage + size);
+    return false;
+  });
+  REQUIRE(streamed_text == snapshot->text());
+  delete snapshot;
+}
+
+TEST_CASE("TextBuffer::clip_position - repeated queries between edits") {
+  TextBuffer buffer{u"abc\r\ndef\nghi"};
+  buffer.set_text_in_range({{1, 1}, {1, 1}}, u"12");
+  REQUIRE(buffer.clip_position({1, 2}).offset == 7);
+  REQUIRE(buffer.clip_position({1, 10}).position == Point(1, 5));
+  REQUIRE(buffer.position_for_offset(9) == Point(1, 4));
+
+  buffer.set_text_in_range({{1, 0}, {1, 0}}, u"\r\n0");
+  REQUIRE(buffer.text() == u"abc\r\n\r\n0d12ef\nghi");
+  REQUIRE(buffer.clip_position({1, 2}).position == Point(1, 0));
+  REQUIRE(buffer.clip_position({2, 2}).offset == 9);
+  REQUIRE(buffer.clip_position({2, 10}).position == Point(2, 6));
+  REQUIRE(buffer.position_for_offset(5) == Point(1, 0));
+  REQUIRE(buffer.position_for_offset(9) == Point(2, 2));
+
+  buffer.reset(Text{u"a\nbc"});
+  REQUIRE(buffer.clip_position({1, 10}).position == Point(1, 2));
+  REQUIRE(buffer.position_for_offset(3) == Point(1, 1));
+}
+
 TEST_CASE("TextBuffer::line_length_for_row - basic") {
   TextBuffer buffer{u"a\n\nb\r\rc\r\n\r\n"};
   REQUIRE(*buffer.line_length_for_row(0) == 1);
   REQUIRE(*buffer.line_length_for_row(1) == 0);
 }
 
+TEST_CASE("TextBuffer::longest_row") {
+  u16string text;
+  for (uint32_t row = 0; row < 1000; row++) {
+    text += u16string(row % 97, 'a') + (row % 3 ? u"\n" : u"\r\n");
+  }
+  TextBuffer buffer{text};
+  REQUIRE(buffer.longest_row() == 96);
+
+  buffer.set_text_in_range({{500, 0}, {500, 0}}, u16string(100, 'b'));
+  REQUIRE(buffer.longest_row() == 500);
+  REQUIRE(*buffer.line_length_for_row(500) == 100 + 500 % 97);
+
+  auto snapshot = buffer.create_snapshot();
+  buffer.set_text_in_range({{500, 0}, {501, 0}}, u"");
+  REQUIRE(buffer.longest_row() == 96);
+  buffer.set_text_in_range({{700, 3}, {700, 3}}, u"\r");
+  buffer.set_text_in_range({{701, 0}, {701, 0}}, u"\n" + u16string(100, 'c'));
+  REQUIRE(buffer.longest_row() == 702);
+  buffer.flush_changes();
+  REQUIRE(buffer.longest_row() == 702);
+  delete snapshot;
+
+  buffer.set_text_in_range({{0, 0}, {999, 0}}, u"");
+  REQUIRE(buffer.longest_row() == 0);
+
+  // Rows lying wholly within inserted text are looked up in the patch.
+  buffer.set_text_in_range({{0, 0}, {0, 0}}, u"a\n" + u16string(200, 'b') + u"\nc\n" + u16string(150, 'd') + u"\ne");
+  REQUIRE(buffer.longest_row() == 1);
+  buffer.set_text_in_range({{3, 10}, {3, 10}}, u16string(100, 'f'));
+  REQUIRE(buffer.longest_row() == 3);
+  snapshot = buffer.create_snapshot();
+  buffer.set_text_in_range({{4, 1}, {4, 1}}, u"g");
+  REQUIRE(buffer.longest_row() == 3);
+  buffer.set_text_in_range({{3, 0}, {3, 250}}, u"");
+  REQUIRE(buffer.longest_row() == 1);
+  delete snapshot;
+}
+
 TEST_CASE("TextBuffer::position_for_offset") {
   TextBuffer buffer{u"ab\ndef\r\nhijk"};
   buffer.set_text_in_range({{0, 2}, {0, 2}}, u"c");
@@ -50,6 +268,55 @@ TEST_CASE("TextBuffer::position_for_offset") {
   REQUIRE(buffer.position_for_offset(10) == Point(2, 0));
 }
 
+TEST_CASE("TextBuffer::utf8_offset_for_position and ::position_for_utf8_offset") {
+  TextBuffer buffer{u"aé中\U0001F600\r\nb"};
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"xy");
+  buffer.set_text_in_range({{1, 1}, {1, 1}}, u"\U0001F600");
+  REQUIRE(buffer.text() == u"axy中\U0001F600\r\nb\U0001F600");
+
+  REQUIRE(buffer.utf8_offset_for_position({0, 0}) == 0);
+  REQUIRE(buffer.utf8_offset_for_position({0, 3}) == 3);
+  REQUIRE(buffer.utf8_offset_for_position({0, 4}) == 6);
+  REQUIRE(buffer.utf8_offset_for_position({0, 6}) == 10);
+  REQUIRE(buffer.utf8_offset_for_position({0, 100}) == 10);
+  REQUIRE(buffer.utf8_offset_for_position({1, 0}) == 12);
+  REQUIRE(buffer.utf8_offset_for_position({1, 1}) == 13);
+  REQUIRE(buffer.utf8_offset_for_position({1, 3}) == 17);
+
+  REQUIRE(buffer.position_for_utf8_offset(3) == Point(0, 3));
+  REQUIRE(buffer.position_for_utf8_offset(5) == Point(0, 3));
+  REQUIRE(buffer.position_for_utf8_offset(6) == Point(0, 4));
+  REQUIRE(buffer.position_for_utf8_offset(8) == Point(0, 4));
+  REQUIRE(buffer.position_for_utf8_offset(10) == Point(0, 6));
+  REQUIRE(buffer.position_for_utf8_offset(11) == Point(0, 6));
+  REQUIRE(buffer.position_for_utf8_offset(12) == Point(1, 0));
+  REQUIRE(buffer.position_for_utf8_offset(15) == Point(1, 1));
+  REQUIRE(buffer.position_for_utf8_offset(100) == Point(1, 3));
+
+  REQUIRE(buffer.code_point_offset_for_position({0, 4}) == 4);
+  REQUIRE(buffer.code_point_offset_for_position({0, 6}) == 5);
+  REQUIRE(buffer.code_point_offset_for_position({1, 0}) == 7);
+  REQUIRE(buffer.code_point_offset_for_position({1, 3}) == 9);
+  REQUIRE(buffer.position_for_code_point_offset(4) == Point(0, 4));
+  REQUIRE(buffer.position_for_code_point_offset(5) == Point(0, 6));
+  REQUIRE(buffer.position_for_code_point_offset(8) == Point(1, 1));
+  REQUIRE(buffer.position_for_code_point_offset(100) == Point(1, 3));
+
+  SECTION("after deserializing the changes") {
+    vector<uint8_t> bytes;
+    Serializer serializer(bytes);
+    buffer.serialize_changes(serializer);
+    TextBuffer copy_buffer{String{buffer.base_text().content}};
+    Deserializer deserializer(bytes);
+    copy_buffer.deserialize_changes(deserializer);
+
+    REQUIRE(copy_buffer.utf8_offset_for_position({1, 0}) == 12);
+    REQUIRE(copy_buffer.position_for_utf8_offset(15) == Point(1, 1));
+    REQUIRE(copy_buffer.code_point_offset_for_position({1, 3}) == 9);
+    REQUIRE(copy_buffer.position_for_code_point_offset(5) == Point(0, 6));
+  }
+}
+
 TEST_CASE("TextBuffer::create_snapshot") {
   TextBuffer buffer{u"ab\ndef"};
   buffer.set_text_in_range({{0, 2}, {0, 2}}, u"c");
@@ -97,6 +364,213 @@ TEST_CASE("TextBuffer::create_snapshot") {
   }
 }
 
+TEST_CASE("TextBuffer::fork") {
+  TextBuffer buffer{u"abc\ndef"};
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"B");
+
+  auto fork = buffer.fork();
+  REQUIRE(fork->text() == u"aBc\ndef");
+  REQUIRE(fork->is_modified());
+  REQUIRE(fork->memory_usage().back().patch.node_count == 0);
+
+  buffer.set_text_in_range({{1, 0}, {1, 1}}, u"D");
+  fork->set_text_in_range({{0, 0}, {0, 0}}, u"x\n");
+  REQUIRE(buffer.text() == u"aBc\nDef");
+  REQUIRE(fork->text() == u"x\naBc\ndef");
+  REQUIRE(*fork->line_length_for_row(1) == 3);
+
+  buffer.flush_changes();
+  REQUIRE(fork->text() == u"x\naBc\ndef");
+
+  SECTION("flushing and editing the fork") {
+    auto snapshot = fork->create_snapshot();
+    fork->flush_changes();
+    REQUIRE(!fork->is_modified());
+    fork->set_text_in_range({{2, 0}, {2, 3}}, u"");
+    REQUIRE(fork->text() == u"x\naBc\n");
+    REQUIRE(snapshot->text() == u"x\naBc\ndef");
+    REQUIRE(buffer.text() == u"aBc\nDef");
+    delete snapshot;
+
+    delete fork;
+    REQUIRE(buffer.layer_count() == 1);
+    REQUIRE(buffer.text() == u"aBc\nDef");
+  }
+
+  SECTION("forking a fork") {
+    auto fork_of_fork = fork->fork();
+    fork->set_text_in_range({{0, 0}, {1, 0}}, u"");
+    fork_of_fork->set_text_in_range({{2, 0}, {2, 0}}, u"y");
+    REQUIRE(fork->text() == u"aBc\ndef");
+    REQUIRE(fork_of_fork->text() == u"x\naBc\nydef");
+    delete fork_of_fork;
+    delete fork;
+    REQUIRE(buffer.layer_count() == 1);
+  }
+
+  SECTION("resetting the fork") {
+    fork->reset(Text{u"123"});
+    REQUIRE(fork->layer_count() == 1);
+    REQUIRE(buffer.layer_count() == 1);
+    REQUIRE(fork->text() == u"123");
+    REQUIRE(buffer.text() == u"aBc\nDef");
+    delete fork;
+  }
+
+  SECTION("materializing checkpoint layers in the fork") {
+    ScopedSetting<uint32_t> max_read_depth{TextBuffer::MAX_LAYER_READ_DEPTH, 4};
+
+    u16string text = u"x\naBc\ndef";
+    vector<TextBuffer::Snapshot *> snapshots;
+    vector<u16string> snapshot_texts;
+    for (uint32_t i = 0; i < 40; i++) {
+      fork->set_text_in_range({{0, 0}, {0, 0}}, u"y");
+      text = u"y" + text;
+      snapshots.push_back(fork->create_snapshot());
+      snapshot_texts.push_back(text);
+    }
+    REQUIRE(fork->layer_statistics().read_depth <= 4);
+
+    for (uint32_t i = 0; i < snapshots.size(); i++) {
+      delete snapshots[i];
+      REQUIRE(fork->text() == text);
+      for (uint32_t j = i + 1; j < snapshots.size(); j++) {
+        REQUIRE(snapshots[j]->text() == snapshot_texts[j]);
+      }
+    }
+
+    vector<uint32_t> checkpoints;
+    for (uint32_t i = 0; i < 40; i++) {
+      checkpoints.push_back(fork->create_checkpoint());
+      fork->set_text_in_range({{0, i}, {0, i + 1}}, u"z");
+    }
+    REQUIRE(fork->revert_to_checkpoint(checkpoints[20]));
+    REQUIRE(fork->text() == u16string(20, 'z') + text.substr(20));
+    for (uint32_t i = 0; i < 20; i++) checkpoints.push_back(fork->create_checkpoint());
+
+    delete fork;
+    REQUIRE(buffer.layer_count() == 1);
+    REQUIRE(buffer.text() == u"aBc\nDef");
+  }
+}
+
+TEST_CASE("TextBuffer::create_checkpoint and ::revert_to_checkpoint") {
+  TextBuffer buffer{u"abc\ndef"};
+  auto checkpoint1 = buffer.create_checkpoint();
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"B");
+  auto checkpoint2 = buffer.create_checkpoint();
+  buffer.set_text_in_range({{1, 0}, {1, 3}}, u"DEF\nghi");
+  buffer.flush_changes();
+  auto checkpoint3 = buffer.create_checkpoint();
+  buffer.set_text_in_range({{0, 0}, {0, 0}}, u"x");
+  REQUIRE(buffer.text() == u"xaBc\nDEF\nghi");
+
+  SECTION("reverting to each checkpoint in turn") {
+    REQUIRE(buffer.revert_to_checkpoint(checkpoint3));
+    REQUIRE(buffer.text() == u"aBc\nDEF\nghi");
+    REQUIRE(buffer.revert_to_checkpoint(checkpoint2));
+    REQUIRE(buffer.text() == u"aBc\ndef");
+    REQUIRE(!buffer.revert_to_checkpoint(checkpoint3));
+    REQUIRE(buffer.revert_to_checkpoint(checkpoint1));
+    REQUIRE(buffer.text() == u"abc\ndef");
+    REQUIRE(buffer.is_modified());
+    REQUIRE(!buffer.revert_to_checkpoint(checkpoint2));
+  }
+
+  SECTION("grouping changes since a checkpoint") {
+    size_t layer_count = buffer.layer_count();
+    REQUIRE(buffer.group_changes_since(checkpoint1));
+    REQUIRE(buffer.layer_count() < layer_count);
+    REQUIRE(!buffer.revert_to_checkpoint(checkpoint2));
+    REQUIRE(buffer.text() == u"xaBc\nDEF\nghi");
+    REQUIRE(buffer.revert_to_checkpoint(checkpoint1));
+    REQUIRE(buffer.text() == u"abc\ndef");
+  }
+
+  SECTION("evicting checkpoints beyond the memory budget") {
+    ScopedSetting<size_t> memory_budget{TextBuffer::CHECKPOINT_MEMORY_BUDGET, 0};
+    auto checkpoint4 = buffer.create_checkpoint();
+    memory_budget.setting = memory_budget.original_value;
+    REQUIRE(!buffer.revert_to_checkpoint(checkpoint1));
+    REQUIRE(!buffer.revert_to_checkpoint(checkpoint3));
+    buffer.set_text_in_range({{0, 0}, {0, 1}}, u"");
+    REQUIRE(buffer.revert_to_checkpoint(checkpoint4));
+    REQUIRE(buffer.text() == u"xaBc\nDEF\nghi");
+  }
+
+  REQUIRE(!buffer.revert_to_checkpoint(100));
+  REQUIRE(!buffer.group_changes_since(100));
+}
+
+TEST_CASE("TextBuffer::revert_to_checkpoint - joined line endings") {
+  TextBuffer buffer{u"ab\ncd"};
+  auto checkpoint1 = buffer.create_checkpoint();
+  buffer.set_text_in_range({{0, 2}, {0, 2}}, u"\r");
+  REQUIRE(buffer.text() == u"ab\r\ncd");
+  REQUIRE(buffer.revert_to_checkpoint(checkpoint1));
+  REQUIRE(buffer.text() == u"ab\ncd");
+  REQUIRE(buffer.utf8_offset_for_position({1, 0}) == 3);
+
+  buffer.set_text_in_range({{0, 2}, {0, 2}}, u"\rX");
+  auto checkpoint2 = buffer.create_checkpoint();
+  buffer.set_text_in_range({{0, 3}, {0, 4}}, u"");
+  REQUIRE(buffer.text() == u"ab\r\ncd");
+  REQUIRE(buffer.revert_to_checkpoint(checkpoint2));
+  REQUIRE(buffer.text() == u"ab\rX\ncd");
+  REQUIRE(buffer.utf8_offset_for_position({1, 0}) == 5);
+  REQUIRE(buffer.revert_to_checkpoint(checkpoint1));
+  REQUIRE(buffer.text() == u"ab\ncd");
+}
+
+TEST_CASE("TextBuffer::create_checkpoint - checkpoints beyond the read depth") {
+  ScopedSetting<uint32_t> max_read_depth{TextBuffer::MAX_LAYER_READ_DEPTH, 4};
+  ScopedSetting<size_t> memory_budget{TextBuffer::CHECKPOINT_MEMORY_BUDGET, 0};
+
+  u16string text(64 * 1024, 'a');
+  TextBuffer buffer{text};
+  vector<uint32_t> checkpoints;
+  auto create_checkpoints = [&](uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t column = checkpoints.size();
+      checkpoints.push_back(buffer.create_checkpoint());
+      buffer.set_text_in_range({{0, column}, {0, column + 1}}, u"b");
+    }
+    REQUIRE(buffer.layer_statistics().read_depth <= 4);
+  };
+
+  SECTION("keeping checkpoints within the memory budget") {
+    memory_budget.setting = 1024 * 1024;
+    create_checkpoints(16);
+    REQUIRE(buffer.revert_to_checkpoint(checkpoints[8]));
+    REQUIRE(buffer.text() == u16string(8, 'b') + text.substr(8));
+    REQUIRE(buffer.revert_to_checkpoint(checkpoints[0]));
+    REQUIRE(buffer.text() == text);
+    REQUIRE(!buffer.is_modified());
+  }
+
+  SECTION("charging checkpoints for the texts of checkpoint layers") {
+    memory_budget.setting = 256 * 1024;
+    create_checkpoints(64);
+
+    // Beyond the budget, only the newest checkpoint layer, which the newest
+    // checkpoint reads through, is retained.
+    size_t base_text_bytes = 0, text_bytes = 0;
+    for (auto &layer : buffer.memory_usage()) {
+      if (layer.is_base_layer) {
+        base_text_bytes = layer.text_bytes;
+      } else {
+        text_bytes += layer.text_bytes;
+      }
+    }
+    REQUIRE(text_bytes > 0);
+    REQUIRE(text_bytes <= memory_budget.setting + base_text_bytes);
+
+    REQUIRE(!buffer.revert_to_checkpoint(checkpoints[0]));
+    REQUIRE(buffer.revert_to_checkpoint(checkpoints[60]));
+    REQUIRE(buffer.text() == u16string(60, 'b') + text.substr(60));
+  }
+}
+
 TEST_CASE("TextBuffer::get_inverted_changes") {
   TextBuffer buffer{u"ab\ndef"};
   auto snapshot1 = buffer.create_snapshot();
@@ -121,6 +595,61 @@ TEST_CASE("TextBuffer::get_inverted_changes") {
   delete snapshot1;
 }
 
+TEST_CASE("TextBuffer::changes_between") {
+  TextBuffer buffer{u"abc\ndef\nghi"};
+  auto snapshot1 = buffer.create_snapshot();
+
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"BB");
+  buffer.set_text_in_range({{2, 0}, {2, 0}}, u"x\n");
+  auto snapshot2 = buffer.create_snapshot();
+  auto snapshot3 = buffer.create_snapshot();
+
+  buffer.set_text_in_range({{1, 1}, {2, 1}}, u"");
+  buffer.flush_changes();
+  auto snapshot4 = buffer.create_snapshot();
+
+  REQUIRE(buffer.changes_between(snapshot2, snapshot3).get_change_count() == 0);
+
+  REQUIRE(buffer.changes_between(snapshot1, snapshot2).get_changes() == vector<Patch::Change>({
+    Patch::Change{
+      Point {0, 1}, Point {0, 2},
+      Point {0, 1}, Point {0, 3},
+      get_text(u"b").get(),
+      get_text(u"BB").get(),
+      0, 0, 0
+    },
+    Patch::Change{
+      Point {2, 0}, Point {2, 0},
+      Point {2, 0}, Point {3, 0},
+      get_text(u"").get(),
+      get_text(u"x\n").get(),
+      0, 0, 0
+    },
+  }));
+
+  auto patch = buffer.changes_between(snapshot1, snapshot4);
+  Text text{snapshot1->text()};
+  for (auto change : patch.get_changes()) {
+    REQUIRE(change.old_text->content == snapshot1->text_in_range({change.old_start, change.old_end}));
+  }
+  for (auto change : patch.get_changes()) {
+    text.splice(change.new_start, change.old_end.traversal(change.old_start), *change.new_text);
+  }
+  REQUIRE(text == Text{snapshot4->text()});
+
+  auto inverted_patch = buffer.changes_between(snapshot4, snapshot1);
+  text = Text{snapshot4->text()};
+  for (auto change : inverted_patch.get_changes()) {
+    text.splice(change.new_start, change.old_end.traversal(change.old_start), *change.new_text);
+  }
+  REQUIRE(text == Text{snapshot1->text()});
+
+  delete snapshot1;
+  delete snapshot2;
+  delete snapshot3;
+  delete snapshot4;
+}
+
 TEST_CASE("TextBuffer::is_modified") {
   TextBuffer buffer{u"abcdef"};
   REQUIRE(!buffer.is_modified());
@@ -163,6 +692,24 @@ TEST_CASE("TextBuffer::is_modified") {
     delete snapshot3;
     delete snapshot4;
   }
+
+  SECTION("undoing a change beneath checkpoint layers") {
+    ScopedSetting<uint32_t> max_read_depth{TextBuffer::MAX_LAYER_READ_DEPTH, 1};
+
+    auto snapshot1 = buffer.create_snapshot();
+    buffer.set_text_in_range({{0, 1}, {0, 4}}, u"X");
+    REQUIRE(buffer.is_modified());
+
+    auto snapshot2 = buffer.create_snapshot();
+    buffer.set_text_in_range({{0, 1}, {0, 2}}, u"b");
+    REQUIRE(buffer.text() == u"abcdef");
+    REQUIRE(buffer.layer_statistics().read_depth == 1);
+    REQUIRE(!buffer.is_modified());
+    REQUIRE(!buffer.is_modified(snapshot2));
+
+    delete snapshot1;
+    delete snapshot2;
+  }
 }
 
 TEST_CASE("TextBuffer::flush_changes") {
@@ -200,6 +747,29 @@ TEST_CASE("TextBuffer::flush_changes") {
   REQUIRE(buffer.layer_count() == 1);
 }
 
+TEST_CASE("TextBuffer::flush_changes - multiple lines") {
+  TextBuffer buffer{u"abc\ndef\r\nghi\njkl"};
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"B\nB");
+  auto snapshot = buffer.create_snapshot();
+  buffer.set_text_in_range({{2, 2}, {3, 1}}, u"");
+  buffer.set_text_in_range({{3, 0}, {3, 0}}, u"\r\nxyz\n");
+  buffer.set_text_in_range(Range{buffer.extent(), buffer.extent()}, u"\n");
+
+  Text expected_text{u"aB\nBc\ndehi\n\r\nxyz\njkl\n"};
+  REQUIRE(buffer.text() == expected_text.content);
+
+  buffer.flush_changes();
+  REQUIRE(buffer.base_text() == expected_text);
+  REQUIRE(buffer.base_text().line_offsets == expected_text.line_offsets);
+  REQUIRE(snapshot->text() == u"aB\nBc\ndef\r\nghi\njkl");
+
+  snapshot->flush_preceding_changes();
+  REQUIRE(snapshot->text() == u"aB\nBc\ndef\r\nghi\njkl");
+  REQUIRE(snapshot->line_length_for_row(2) == 3);
+  REQUIRE(snapshot->line_length_for_row(3) == 3);
+  delete snapshot;
+}
+
 TEST_CASE("Snapshot::flush_preceding_changes") {
   TextBuffer buffer{u"abcdef"};
   REQUIRE(buffer.layer_count() == 1);
@@ -267,6 +837,196 @@ TEST_CASE("Snapshot::flush_preceding_changes") {
   }
 }
 
+TEST_CASE("Snapshot::compute_preceding_text") {
+  TextBuffer buffer{u"abc\ndef"};
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"B\n");
+  auto snapshot = buffer.create_snapshot();
+
+  auto future = std::async(std::launch::async, [snapshot]() {
+    return snapshot->compute_preceding_text();
+  });
+
+  buffer.set_text_in_range({{2, 0}, {2, 1}}, u"D");
+  buffer.set_text_in_range({{0, 0}, {0, 0}}, u"0");
+  REQUIRE(buffer.text() == u"0aB\nc\nDef");
+
+  snapshot->flush_preceding_changes(future.get());
+  REQUIRE(buffer.base_text() == Text{u"aB\nc\ndef"});
+  REQUIRE(snapshot->text() == u"aB\nc\ndef");
+  REQUIRE(buffer.text() == u"0aB\nc\nDef");
+  REQUIRE(buffer.is_modified());
+
+  delete snapshot;
+  REQUIRE(buffer.layer_count() == 2);
+  REQUIRE(buffer.text() == u"0aB\nc\nDef");
+  REQUIRE(*buffer.line_length_for_row(1) == 1);
+}
+
+TEST_CASE("Snapshot - concurrent reads") {
+  TextBuffer buffer{u"abc\ndef\r\nghi"};
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"BBB\r");
+  auto snapshot1 = buffer.create_snapshot();
+  buffer.set_text_in_range({{2, 0}, {2, 1}}, u"\nefg");
+  auto snapshot2 = buffer.create_snapshot();
+  auto snapshot3 = buffer.create_snapshot();
+
+  Text expected_text{u"aBBB\rc\ndef\r\n\nefghi"};
+  Text expected_lines{u"aBBB\rcdefefghi"};
+  REQUIRE(snapshot2->text() == expected_text.content);
+  Regex regex(u"e+fg", nullptr);
+
+  vector<std::future<bool>> readers;
+  for (uint32_t i = 0; i < 4; i++) {
+    readers.push_back(std::async(std::launch::async, [&]() {
+      for (uint32_t j = 0; j < 200; j++) {
+        if (snapshot2->text() != expected_text.content) return false;
+        if (snapshot2->find(regex) != optional<Range>{Range{{3, 0}, {3, 3}}}) return false;
+        if (snapshot2->line_length_for_row(0) != 6) return false;
+        Text::String lines;
+        for (auto iter = snapshot2->line_iterator(0, 5); iter != TextBuffer::LineIterator(); ++iter) {
+          lines.insert(lines.end(), iter->data, iter->data + iter->size);
+        }
+        if (lines != expected_lines.content) return false;
+        uint16_t copy_buffer[4];
+        Text::String copied_text;
+        snapshot2->copy_text_in_range({{0, 0}, snapshot2->extent()}, copy_buffer, 4, [&](uint32_t size) {
+          copied_text.insert(copied_text.end(), copy_buffer, copy_buffer + size);
+          return false;
+        });
+        if (copied_text != expected_text.content) return false;
+      }
+      return true;
+    }));
+  }
+
+  for (uint32_t i = 0; i < 50; i++) {
+    buffer.set_text_in_range({{0, 0}, {0, 0}}, u"x");
+    delete buffer.create_snapshot();
+    buffer.line_length_for_row(1);
+  }
+  snapshot3->flush_preceding_changes();
+  delete snapshot3;
+  delete snapshot1;
+
+  for (auto &reader : readers) REQUIRE(reader.get());
+  REQUIRE(snapshot2->text() == expected_text.content);
+  delete snapshot2;
+  expected_text.splice({0, 0}, {0, 0}, Text{u16string(50, 'x')});
+  REQUIRE(buffer.text() == expected_text.content);
+}
+
+TEST_CASE("TextBuffer - freeing layers beneath flushed changes") {
+  TextBuffer buffer{u"abcdef"};
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"B");
+  auto snapshot1 = buffer.create_snapshot();
+
+  buffer.set_text_in_range({{0, 2}, {0, 3}}, u"C");
+  buffer.flush_changes();
+  auto snapshot2 = buffer.create_snapshot();
+  REQUIRE(buffer.layer_count() == 3);
+
+  delete snapshot1;
+  REQUIRE(buffer.layer_count() == 1);
+  REQUIRE(buffer.text() == u"aBCdef");
+  REQUIRE(snapshot2->text() == u"aBCdef");
+  REQUIRE(!buffer.is_modified());
+
+  buffer.set_text_in_range({{0, 3}, {0, 4}}, u"D");
+  REQUIRE(buffer.text() == u"aBCDef");
+  REQUIRE(snapshot2->text() == u"aBCdef");
+
+  delete snapshot2;
+  REQUIRE(buffer.layer_count() == 2);
+  REQUIRE(buffer.text() == u"aBCDef");
+}
+
+TEST_CASE("TextBuffer - bounding the depth of layers pinned by snapshots") {
+  ScopedSetting<uint32_t> max_read_depth{TextBuffer::MAX_LAYER_READ_DEPTH, 4};
+
+  TextBuffer buffer{u"abc"};
+  vector<TextBuffer::Snapshot *> snapshots;
+  u16string text = u"abc";
+  for (uint32_t i = 0; i < 10; i++) {
+    buffer.set_text_in_range({{0, 0}, {0, 0}}, u"x");
+    text = u"x" + text;
+    snapshots.push_back(buffer.create_snapshot());
+    REQUIRE(buffer.layer_statistics().read_depth <= 4);
+  }
+
+  auto statistics = buffer.layer_statistics();
+  REQUIRE(statistics.layer_count == 13);
+  REQUIRE(statistics.read_depth == 2);
+  REQUIRE(statistics.change_count == 2);
+  REQUIRE(buffer.text() == text);
+  for (uint32_t i = 0; i < snapshots.size(); i++) {
+    REQUIRE(snapshots[i]->text() == text.substr(snapshots.size() - 1 - i));
+  }
+
+  for (auto snapshot : snapshots) delete snapshot;
+  statistics = buffer.layer_statistics();
+  REQUIRE(statistics.layer_count == 2);
+  REQUIRE(statistics.read_depth == 1);
+  REQUIRE(statistics.change_count == 1);
+  REQUIRE(buffer.text() == text);
+  REQUIRE(buffer.is_modified());
+}
+
+TEST_CASE("TextBuffer - leaving long buffers unmaterialized") {
+  ScopedSetting<uint32_t> max_read_depth{TextBuffer::MAX_LAYER_READ_DEPTH, 4};
+  ScopedSetting<uint32_t> max_checkpoint_size{TextBuffer::MAX_CHECKPOINT_TEXT_SIZE, 8};
+
+  TextBuffer buffer{u"abc"};
+  vector<TextBuffer::Snapshot *> snapshots;
+  u16string text = u"abc";
+  for (uint32_t i = 0; i < 10; i++) {
+    buffer.set_text_in_range({{0, 0}, {0, 0}}, u"x");
+    text = u"x" + text;
+    snapshots.push_back(buffer.create_snapshot());
+  }
+
+  // Only one checkpoint is created before the text grows past 8 characters.
+  auto statistics = buffer.layer_statistics();
+  REQUIRE(statistics.layer_count == 12);
+  REQUIRE(statistics.read_depth == 6);
+  REQUIRE(buffer.text() == text);
+  for (uint32_t i = 0; i < snapshots.size(); i++) {
+    REQUIRE(snapshots[i]->text() == text.substr(snapshots.size() - 1 - i));
+  }
+
+  for (auto snapshot : snapshots) delete snapshot;
+  REQUIRE(buffer.layer_statistics().layer_count == 2);
+  REQUIRE(buffer.text() == text);
+}
+
+TEST_CASE("TextBuffer::memory_usage") {
+  TextBuffer buffer{u"abc\ndef"};
+  auto memory_usage = buffer.memory_usage();
+  REQUIRE(memory_usage.size() == 1);
+  REQUIRE(memory_usage[0].is_base_layer);
+  REQUIRE(memory_usage[0].text_bytes >= 7 * sizeof(uint16_t) + 2 * sizeof(uint32_t));
+  REQUIRE(memory_usage[0].patch.node_count == 0);
+
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"BBB");
+  auto snapshot = buffer.create_snapshot();
+  buffer.set_text_in_range({{1, 0}, {1, 0}}, u"x");
+  buffer.set_text_in_range({{1, 3}, {1, 3}}, u"y");
+
+  memory_usage = buffer.memory_usage();
+  REQUIRE(memory_usage.size() == 3);
+  REQUIRE(memory_usage[0].is_base_layer);
+  REQUIRE(memory_usage[0].snapshot_count == 1);
+  REQUIRE(!memory_usage[1].is_base_layer);
+  REQUIRE(memory_usage[1].snapshot_count == 1);
+  REQUIRE(memory_usage[1].text_bytes == 0);
+  REQUIRE(memory_usage[1].patch.node_count == 1);
+  REQUIRE(memory_usage[1].patch.new_text_bytes >= sizeof(Text) + 3 * sizeof(uint16_t));
+  REQUIRE(memory_usage[2].snapshot_count == 0);
+  REQUIRE(memory_usage[2].patch.node_count == 2);
+
+  delete snapshot;
+  REQUIRE(buffer.memory_usage().size() == 2);
+}
+
 TEST_CASE("TextBuffer::reset") {
   TextBuffer buffer{u"abcdef"};
   auto snapshot1 = buffer.create_snapshot();
@@ -396,11 +1156,108 @@ void query_random_ranges(TextBuffer &buffer, Generator &rand, Text &mutated_text
     REQUIRE(buffer.text_in_range(range) == expected_text);
     REQUIRE(buffer.position_for_offset(buffer.clip_position(range.start).offset) == range.start);
     REQUIRE(buffer.position_for_offset(buffer.clip_position(range.end).offset) == range.end);
+
+    String chunk_text;
+    for (auto iter = buffer.chunk_iterator(range); iter != TextBuffer::ChunkIterator(); ++iter) {
+      chunk_text.insert(chunk_text.end(), iter->begin(), iter->end());
+    }
+    REQUIRE(chunk_text == expected_text);
+
+    uint16_t copy_buffer[7];
+    String copied_text;
+    buffer.copy_text_in_range(range, copy_buffer, 7, [&](uint32_t size) {
+      copied_text.insert(copied_text.end(), copy_buffer, copy_buffer + size);
+      return false;
+    });
+    REQUIRE(copied_text == expected_text);
+
+    uint32_t row = range.start.row;
+    for (auto iter = buffer.line_iterator(range.start.row, range.end.row + 1);
+         iter != TextBuffer::LineIterator(); ++iter, ++row) {
+      TextSlice line = TextSlice(mutated_text).slice({{row, 0}, {row, mutated_text.line_length_for_row(row)}});
+      REQUIRE(iter->row == row);
+      REQUIRE(String(iter->data, iter->data + iter->size) == String(line.begin(), line.end()));
+    }
+    REQUIRE(row == range.end.row + 1);
+  }
+
+  uint32_t longest_row = 0;
+  for (uint32_t row = 1; row <= mutated_text.extent().row; row++) {
+    if (mutated_text.line_length_for_row(row) > mutated_text.line_length_for_row(longest_row)) {
+      longest_row = row;
+    }
+  }
+  REQUIRE(buffer.longest_row() == longest_row);
+}
+
+static u16string get_random_encoded_string(Generator &rand) {
+  static const char16_t *characters[] = {u"a", u"é", u"中", u"\U0001F600", u"\n", u"\r\n", u"\r"};
+  u16string result;
+  for (uint32_t i = 0, n = rand() % 20; i < n; i++) {
+    result += characters[rand() % 7];
+  }
+  return result;
+}
+
+// Moves positions that fall between the halves of a surrogate pair to the
+// pair's start, so that random edits don't split characters.
+static Point clip_to_code_point(const Text &text, Point position) {
+  ClipResult clip_result = text.clip_position(position);
+  uint32_t offset = clip_result.offset;
+  if (offset > 0 && offset < text.size() &&
+      (text.at(offset) & 0xFC00) == 0xDC00 && (text.at(offset - 1) & 0xFC00) == 0xD800) {
+    return Point(clip_result.position.row, clip_result.position.column - 1);
+  }
+  return clip_result.position;
+}
+
+TEST_CASE("TextBuffer - random edits and encoded offsets") {
+  ScopedSetting<uint32_t> max_read_depth{TextBuffer::MAX_LAYER_READ_DEPTH, 3};
+
+  auto t = time(nullptr);
+  for (uint i = 0; i < 100; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    Text mutated_text{get_random_encoded_string(rand) + get_random_encoded_string(rand)};
+    TextBuffer buffer{String(mutated_text.content)};
+    vector<TextBuffer::Snapshot *> snapshots;
+
+    for (uint j = 0; j < 15; j++) {
+      if (rand() % 3 == 0) snapshots.push_back(buffer.create_snapshot());
+      if (rand() % 4 == 0 && !snapshots.empty()) {
+        uint32_t snapshot_index = rand() % snapshots.size();
+        delete snapshots[snapshot_index];
+        snapshots.erase(snapshots.begin() + snapshot_index);
+      }
+
+      Range range = get_random_range(rand, mutated_text);
+      range.start = clip_to_code_point(mutated_text, range.start);
+      range.end = clip_to_code_point(mutated_text, range.end);
+      Text inserted_text{get_random_encoded_string(rand)};
+      mutated_text.splice(range.start, range.extent(), inserted_text);
+      buffer.set_text_in_range(range, move(inserted_text.content));
+      REQUIRE(buffer.text() == mutated_text.content);
+
+      for (uint32_t k = 0; k < 10; k++) {
+        Point position = clip_to_code_point(mutated_text, get_random_range(rand, mutated_text).start);
+        uint32_t offset = mutated_text.offset_for_position(position);
+        EncodedSize expected = EncodedSize::of(mutated_text.data(), mutated_text.data() + offset);
+        REQUIRE(buffer.utf8_offset_for_position(position) == expected.utf8_size);
+        REQUIRE(buffer.code_point_offset_for_position(position) == expected.code_point_count);
+        REQUIRE(buffer.position_for_utf8_offset(expected.utf8_size) == position);
+        REQUIRE(buffer.position_for_code_point_offset(expected.code_point_count) == position);
+      }
+    }
+
+    for (auto snapshot : snapshots) delete snapshot;
   }
 }
 
 TEST_CASE("TextBuffer - random edits and queries") {
   TextBuffer::MAX_CHUNK_SIZE_TO_COPY = 2;
+  ScopedSetting<uint32_t> max_read_depth{TextBuffer::MAX_LAYER_READ_DEPTH, 3};
 
   auto t = time(nullptr);
   for (uint i = 0; i < 100; i++) {
@@ -463,6 +1320,7 @@ TEST_CASE("TextBuffer - random edits and queries") {
       // cout << "extent: " << mutated_text.extent() << "\ntext: " << mutated_text << "\n";
       REQUIRE(buffer.extent() == mutated_text.extent());
       REQUIRE(buffer.text() == mutated_text.content);
+      REQUIRE(buffer.is_modified() == (mutated_text.content != buffer.base_text().content));
 
       for (uint32_t row = 0; row < mutated_text.extent().row; row++) {
         REQUIRE(
@@ -74,6 +74,9 @@ TEST_CASE("Text::splice") {
   REQUIRE(text == Text {u"abc\nduvwemno\npkl\nxyz\r\nabc"});
   text.splice({0, 0}, {0, 0}, Text {u"def\nghi"});
   REQUIRE(text == Text {u"def\nghiabc\nduvwemno\npkl\nxyz\r\nabc"});
+  text.splice({1, 0}, {1, 2}, Text {u"g\nhi\nab\nc"});
+  REQUIRE(text == Text {u"def\ng\nhi\nab\ncvwemno\npkl\nxyz\r\nabc"});
+  REQUIRE(text.line_offsets == Text {u"def\ng\nhi\nab\ncvwemno\npkl\nxyz\r\nabc"}.line_offsets);
 }
 
 TEST_CASE("Text::offset_for_position - basic") {
@@ -108,3 +111,44 @@ TEST_CASE("Text::offset_for_position - empty lines") {
   REQUIRE(text.offset_for_position({1, UINT32_MAX}) == 2);
   REQUIRE(slice.position_for_offset(2) == Point(1, 0));
 }
+
+TEST_CASE("Text - line offsets of long content") {
+  auto t = time(nullptr);
+  for (uint32_t i = 0; i < 20; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    std::u16string string = get_random_string(rand, rand() % 1000);
+    if (rand() % 2) string.insert(string.begin(), '\n');
+    if (rand() % 2) string.push_back('\n');
+
+    std::vector<uint32_t> expected_line_offsets{0};
+    for (uint32_t offset = 0; offset < string.size(); offset++) {
+      if (string[offset] == '\n') expected_line_offsets.push_back(offset + 1);
+    }
+
+    REQUIRE(Text{string}.line_offsets == expected_line_offsets);
+
+    Text text{string};
+    TextSlice suffix = TextSlice(text).suffix(text.position_for_offset(rand() % (string.size() + 1)));
+    Text suffix_text{suffix};
+    REQUIRE(Text(suffix.begin(), suffix.end()).line_offsets == suffix_text.line_offsets);
+  }
+}
+
+TEST_CASE("Text::digest") {
+  std::u16string string = u"abc\r\ndefg\n\r\nhijkl abc\r\ndefg\n\r\nhijkl abc";
+  for (uint32_t size = 0; size <= string.size(); size++) {
+    Text text{string.substr(0, size)};
+    REQUIRE(text.digest() == Text{string.substr(0, size)}.digest());
+    if (size > 0) {
+      REQUIRE(text.digest() != Text{string.substr(0, size - 1)}.digest());
+      for (uint32_t offset = 0; offset < size; offset++) {
+        Text changed_text = text;
+        changed_text.content[offset]++;
+        REQUIRE(changed_text.digest() != text.digest());
+      }
+    }
+  }
+}